@@ -119,6 +119,7 @@ def amalgamate_source(source_top_dir=None,
     header.add_file("arbiter/util/transforms.hpp")
     header.add_file("arbiter/util/util.hpp")
 
+    header.add_file("arbiter/stream.hpp")
     header.add_file("arbiter/driver.hpp")
     header.add_file("arbiter/drivers/fs.hpp")
     header.add_file("arbiter/drivers/http.hpp")
@@ -151,6 +152,7 @@ def amalgamate_source(source_top_dir=None,
     source.add_file("arbiter/arbiter.cpp")
     source.add_file("arbiter/driver.cpp")
     source.add_file("arbiter/endpoint.cpp")
+    source.add_file("arbiter/stream.cpp")
     source.add_file("arbiter/drivers/fs.cpp")
     source.add_file("arbiter/drivers/http.cpp")
     source.add_file("arbiter/drivers/s3.cpp")
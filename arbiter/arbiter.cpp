@@ -10,7 +10,9 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <future>
 #include <sstream>
+#include <thread>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -44,18 +46,47 @@ namespace
 
         return merge(in, config);
     }
+
+    // Run @p f, recording its failure, if any, in @p result.
+    void attempt(BatchResult& result, const std::function<void()>& f)
+    {
+        try
+        {
+            f();
+        }
+        catch (std::exception& e)
+        {
+            result.error = e.what();
+        }
+        catch (...)
+        {
+            result.error = "Unknown error";
+        }
+    }
 }
 
 Arbiter::Arbiter() : Arbiter("") { }
 
 Arbiter::Arbiter(const std::string s)
     : m_config(s)
-    , m_pool(
-            new http::Pool(
-                concurrentHttpReqs,
-                httpRetryCount,
-                getConfig(s).dump()))
-{}
+{
+    const json config = getConfig(s);
+
+    std::size_t concurrent(concurrentHttpReqs);
+    std::size_t retry(httpRetryCount);
+
+    const json h(config.value("http", json::object()));
+    if (h.is_object())
+    {
+        concurrent = h.value("concurrent", concurrent);
+        retry = h.value("retry", retry);
+    }
+
+    if (auto v = env("ARBITER_HTTP_CONCURRENT")) concurrent = std::stoul(*v);
+    if (auto v = env("ARBITER_HTTP_RETRY")) retry = std::stoul(*v);
+
+    m_pool.reset(new http::Pool(concurrent, retry, config.dump()));
+}
 
 void Arbiter::addDriver(const std::string type, std::shared_ptr<Driver> driver)
 {
@@ -95,6 +126,45 @@ std::unique_ptr<std::vector<char>> Arbiter::tryGetBinary(std::string path) const
     return getDriver(path)->tryGetBinary(stripProtocol(path));
 }
 
+std::vector<char> Arbiter::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return getDriver(path)->getRange(stripProtocol(path), offset, length);
+}
+
+std::unique_ptr<std::vector<char>> Arbiter::tryGetRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return getDriver(path)->tryGetRange(stripProtocol(path), offset, length);
+}
+
+std::vector<std::vector<char>> Arbiter::getRanges(
+        const std::string path,
+        const std::vector<ByteRange>& ranges,
+        const std::size_t gap) const
+{
+    return getDriver(path)->getRanges(stripProtocol(path), ranges, gap);
+}
+
+std::unique_ptr<ReadStream> Arbiter::openRead(
+        const std::string path,
+        const std::size_t chunkSize,
+        const std::size_t depth) const
+{
+    return getDriver(path)->openRead(stripProtocol(path), chunkSize, depth);
+}
+
+std::unique_ptr<WriteStream> Arbiter::openWrite(
+        const std::string path,
+        const std::size_t partSize) const
+{
+    return getDriver(path)->openWrite(stripProtocol(path), partSize);
+}
+
 std::size_t Arbiter::getSize(const std::string path) const
 {
     return getDriver(path)->getSize(stripProtocol(path));
@@ -119,35 +189,131 @@ std::vector<char> Arbiter::put(
     return getDriver(path)->put(stripProtocol(path), data);
 }
 
+std::vector<BatchResult> Arbiter::getMany(
+        const std::vector<std::string>& paths,
+        const std::size_t concurrency) const
+{
+    std::vector<BatchResult> results(paths.size());
+    batch(paths, concurrency, [&](
+                const std::vector<std::size_t>& indices,
+                std::size_t window)
+    {
+        internal::windowed(indices.size(), window, [&](std::size_t k)
+        {
+            const std::string& path(paths[indices[k]]);
+            return getDriver(path)->fetch(stripProtocol(path));
+        },
+        [&](std::size_t k, std::future<std::vector<char>>& data)
+        {
+            BatchResult& result(results[indices[k]]);
+            attempt(result, [&]() { result.data = data.get(); });
+        });
+    }, results);
+    return results;
+}
+
+std::vector<BatchResult> Arbiter::putMany(
+        const std::vector<std::pair<std::string, std::vector<char>>>& items,
+        const std::size_t concurrency) const
+{
+    std::vector<std::string> paths;
+    for (const auto& item : items) paths.push_back(item.first);
+
+    std::vector<BatchResult> results(items.size());
+    batch(paths, concurrency, [&](
+                const std::vector<std::size_t>& indices,
+                std::size_t threads)
+    {
+        internal::parallelFor(indices.size(), threads, [&](std::size_t k)
+        {
+            const auto& item(items[indices[k]]);
+            attempt(results[indices[k]], [&]() { put(item.first, item.second); });
+        });
+    }, results);
+    return results;
+}
+
+void Arbiter::batch(
+        const std::vector<std::string>& paths,
+        const std::size_t concurrency,
+        const std::function<void(
+            const std::vector<std::size_t>&,
+            std::size_t)>& run,
+        std::vector<BatchResult>& results) const
+{
+    std::vector<std::size_t> remote;
+    std::vector<std::size_t> local;
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        attempt(results[i], [&]()
+        {
+            (isRemote(paths[i]) ? remote : local).push_back(i);
+        });
+    }
+
+    const std::size_t localThreads(
+            concurrency ?
+                concurrency :
+                (std::max)(1u, std::thread::hardware_concurrency()));
+    const std::size_t remoteThreads(
+            concurrency ? concurrency : m_pool->concurrent());
+
+    // Local paths get a thread of their own, alongside the remote ones.
+    std::future<void> locals;
+    if (local.size() && remote.size())
+    {
+        const http::Priority priority(http::PriorityScope::current());
+        const http::Cancellation cancel(http::CancellationScope::current());
+        locals = std::async(std::launch::async, [&, priority, cancel]()
+        {
+            const http::PriorityScope priorityScope(priority);
+            const http::CancellationScope cancelScope(cancel);
+            run(local, localThreads);
+        });
+    }
+    else run(local, localThreads);
+
+    run(remote, remoteThreads);
+    if (locals.valid()) locals.get();
+}
+
 std::string Arbiter::get(
         const std::string path,
         const http::Headers headers,
-        const http::Query query) const
+        const http::Query query,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return getHttpDriver(path)->get(stripProtocol(path), headers, query);
 }
 
 std::unique_ptr<std::string> Arbiter::tryGet(
         const std::string path,
         const http::Headers headers,
-        const http::Query query) const
+        const http::Query query,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return getHttpDriver(path)->tryGet(stripProtocol(path), headers, query);
 }
 
 std::vector<char> Arbiter::getBinary(
         const std::string path,
         const http::Headers headers,
-        const http::Query query) const
+        const http::Query query,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return getHttpDriver(path)->getBinary(stripProtocol(path), headers, query);
 }
 
 std::unique_ptr<std::vector<char>> Arbiter::tryGetBinary(
         const std::string path,
         const http::Headers headers,
-        const http::Query query) const
+        const http::Query query,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return getHttpDriver(path)->tryGetBinary(stripProtocol(path), headers, query);
 }
 
@@ -155,8 +321,10 @@ std::vector<char> Arbiter::put(
         const std::string path,
         const std::string& data,
         const http::Headers headers,
-        const http::Query query) const
+        const http::Query query,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return getHttpDriver(path)->put(stripProtocol(path), data, headers, query);
 }
 
@@ -164,8 +332,10 @@ std::vector<char> Arbiter::put(
         const std::string path,
         const std::vector<char>& data,
         const http::Headers headers,
-        const http::Query query) const
+        const http::Query query,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return getHttpDriver(path)->put(stripProtocol(path), data, headers, query);
 }
 
@@ -289,7 +459,10 @@ std::vector<std::string> Arbiter::resolve(
 
 Endpoint Arbiter::getEndpoint(const std::string root) const
 {
-    return Endpoint(*getDriver(root), stripProtocol(root));
+    return Endpoint(
+            *getDriver(root),
+            stripProtocol(root),
+            m_pool->concurrent());
 }
 
 std::shared_ptr<Driver> Arbiter::getDriver(const std::string path) const
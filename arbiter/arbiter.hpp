@@ -1,7 +1,10 @@
 #pragma once
 
+#include <functional>
 #include <vector>
+#include <optional>
 #include <string>
+#include <utility>
 
 #if defined(_WIN32) || defined(WIN32) || defined(_MSC_VER)
 #define ARBITER_WINDOWS
@@ -17,6 +20,7 @@
 #include <arbiter/drivers/s3.hpp>
 #include <arbiter/drivers/az.hpp>
 #include <arbiter/drivers/test.hpp>
+#include <arbiter/stream.hpp>
 #include <arbiter/util/exports.hpp>
 #include <arbiter/util/types.hpp>
 #include <arbiter/util/util.hpp>
@@ -52,7 +56,13 @@ public:
      */
     Arbiter();
 
-    /** @brief Construct an Arbiter with driver configurations. */
+    /** @brief Construct an Arbiter with driver configurations.
+     *
+     * The shared HTTP pool is sized by the `http.concurrent` (default 32)
+     * and `http.retry` (default 8) configuration values, which may be
+     * overridden by the environment variables `ARBITER_HTTP_CONCURRENT` and
+     * `ARBITER_HTTP_RETRY`.  See http::Pool for its idle handle settings.
+     */
     Arbiter(std::string stringifiedJson);
 
     /** @brief Add a custom driver for the supplied type.
@@ -83,6 +93,39 @@ public:
     /** Get data in binary form if accessible. */
     std::unique_ptr<std::vector<char>> tryGetBinary(std::string path) const;
 
+    /** Get @p length bytes starting at byte @p offset, or throw if
+     * inaccessible.  See Driver::getRange. */
+    std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Get @p length bytes starting at byte @p offset if accessible. */
+    std::unique_ptr<std::vector<char>> tryGetRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Get several byte ranges at once, or throw if any are inaccessible.
+     * See Driver::getRanges. */
+    std::vector<std::vector<char>> getRanges(
+            std::string path,
+            const std::vector<ByteRange>& ranges,
+            std::size_t gap = 64 * 1024) const;
+
+    /** Open a seekable stream over a file, or throw if inaccessible.  See
+     * Driver::openRead. */
+    std::unique_ptr<ReadStream> openRead(
+            std::string path,
+            std::size_t chunkSize = 1024 * 1024,
+            std::size_t depth = 4) const;
+
+    /** Open a stream which writes a file in parts as data arrives.  See
+     * Driver::openWrite. */
+    std::unique_ptr<WriteStream> openWrite(
+            std::string path,
+            std::size_t partSize = 8 * 1024 * 1024) const;
+
     /** Get file size in bytes or throw if inaccessible. */
     std::size_t getSize(std::string path) const;
 
@@ -97,33 +140,64 @@ public:
             std::string path, 
             const std::vector<char>& data) const;
 
+    /** @brief Get many files at once, with one result for each of @p paths.
+     *
+     * Remote paths are fetched through the shared http::Pool without a
+     * thread waiting on each, and local paths at the same time, see
+     * Driver::fetch.  Up to @p concurrency of each are read at once, or if
+     * zero, as many remote paths as the pool runs transfers and as many
+     * local paths as there are hardware threads.  Requests have the
+     * priority and http::Cancellation of the calling thread.  Failures are
+     * reported in the results rather than thrown.
+     */
+    std::vector<BatchResult> getMany(
+            const std::vector<std::string>& paths,
+            std::size_t concurrency = 0) const;
+
+    /** Write many files at once, with one result for each of @p items.  See
+     * Arbiter::getMany, though each write blocks a thread, and those beyond
+     * the calling one are drawn from a limit shared by the whole process,
+     * see internal::parallelFor.
+     */
+    std::vector<BatchResult> putMany(
+            const std::vector<std::pair<std::string, std::vector<char>>>& items,
+            std::size_t concurrency = 0) const;
+
     /** Get data with additional HTTP-specific parameters.  Throws if
-     * isHttpDerived is false for this path. */
+     * isHttpDerived is false for this path.
+     *
+     * The requests for this and the following calls have the given
+     * @p priority, or else that of the calling thread, see
+     * http::PriorityScope. */
     std::string get(
             std::string path,
             http::Headers headers,
-            http::Query query = http::Query()) const;
+            http::Query query = http::Query(),
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     /** Get data with additional HTTP-specific parameters.  Throws if
      * isHttpDerived is false for this path. */
     std::unique_ptr<std::string> tryGet(
             std::string path,
             http::Headers headers,
-            http::Query query = http::Query()) const;
+            http::Query query = http::Query(),
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     /** Get data in binary form with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
     std::vector<char> getBinary(
             std::string path,
             http::Headers headers,
-            http::Query query = http::Query()) const;
+            http::Query query = http::Query(),
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     /** Get data in binary form with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
     std::unique_ptr<std::vector<char>> tryGetBinary(
             std::string path,
             http::Headers headers,
-            http::Query query = http::Query()) const;
+            http::Query query = http::Query(),
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     /** Write data to path with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
@@ -131,7 +205,8 @@ public:
             std::string path,
             const std::string& data,
             http::Headers headers,
-            http::Query query = http::Query()) const;
+            http::Query query = http::Query(),
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     /** Write data to path with additional HTTP-specific parameters.
      * Throws if isHttpDerived is false for this path. */
@@ -139,7 +214,8 @@ public:
             std::string path,
             const std::vector<char>& data,
             http::Headers headers,
-            http::Query query = http::Query()) const;
+            http::Query query = http::Query(),
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     /** Copy data from @p src to @p dst.  @p src will be resolved with
      * Arbiter::resolve prior to the copy, so globbed directories are supported.
@@ -285,6 +361,18 @@ public:
     http::Pool& httpPool() { return *m_pool; }
 
 private:
+    // Call @p run with the indices of the remote @p paths, and alongside
+    // it with those of the local ones, along with how many of each to run
+    // at once, as described by getMany.  Paths which are neither fail in
+    // @p results.
+    void batch(
+            const std::vector<std::string>& paths,
+            std::size_t concurrency,
+            const std::function<void(
+                const std::vector<std::size_t>&,
+                std::size_t)>& run,
+            std::vector<BatchResult>& results) const;
+
     std::shared_ptr<drivers::Http> tryGetHttpDriver(std::string path) const;
     std::shared_ptr<drivers::Http> getHttpDriver(std::string path) const;
 
@@ -2,10 +2,16 @@
 #include <arbiter/driver.hpp>
 
 #include <arbiter/arbiter.hpp>
+#include <arbiter/stream.hpp>
+#include <arbiter/util/http.hpp>
 #include <arbiter/util/json.hpp>
 #include <arbiter/util/util.hpp>
 #endif
 
+#include <algorithm>
+#include <exception>
+#include <future>
+
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
 {
@@ -14,6 +20,62 @@ namespace ARBITER_CUSTOM_NAMESPACE
 namespace arbiter
 {
 
+namespace
+{
+    // Run @p f with the priority and Cancellation of the calling thread, on
+    // a thread of its own if the shared limit allows, or otherwise on the
+    // first thread to wait for its result.
+    template <typename F>
+    auto spare(F f) -> std::future<decltype(f())>
+    {
+        const http::Priority priority(http::PriorityScope::current());
+        const http::Cancellation cancel(http::CancellationScope::current());
+        auto scoped([f, priority, cancel]()
+        {
+            const http::PriorityScope priorityScope(priority);
+            const http::CancellationScope cancelScope(cancel);
+            return f();
+        });
+
+        if (!internal::acquireThreads(1))
+        {
+            return std::async(std::launch::deferred, scoped);
+        }
+
+        return std::async(std::launch::async, [scoped]()
+        {
+            struct Release { ~Release() { internal::releaseThreads(1); } };
+            const Release release;
+            return scoped();
+        });
+    }
+
+    class WholeUpload : public Upload
+    {
+    public:
+        WholeUpload(const Driver& driver, std::string path)
+            : m_driver(driver)
+            , m_path(path)
+        { }
+
+        void write(const std::vector<char>& data) override
+        {
+            m_data.insert(m_data.end(), data.begin(), data.end());
+        }
+
+        void finish(const std::vector<char>& data) override
+        {
+            write(data);
+            m_driver.put(m_path, m_data);
+        }
+
+    private:
+        const Driver& m_driver;
+        const std::string m_path;
+        std::vector<char> m_data;
+    };
+}
+
 std::shared_ptr<Driver> Driver::create(
     http::Pool& pool,
     const std::string protocol,
@@ -42,15 +104,21 @@ std::shared_ptr<Driver> Driver::create(
 
 std::string Driver::get(const std::string path) const
 {
-    const std::vector<char> data(getBinary(path));
-    return std::string(data.begin(), data.end());
+    std::vector<char> data(getBinary(path));
+    std::string result(data.begin(), data.end());
+    recycle(std::move(data));
+    return result;
 }
 
 std::unique_ptr<std::string> Driver::tryGet(const std::string path) const
 {
     std::unique_ptr<std::string> result;
     std::unique_ptr<std::vector<char>> data(tryGetBinary(path));
-    if (data) result.reset(new std::string(data->begin(), data->end()));
+    if (data)
+    {
+        result.reset(new std::string(data->begin(), data->end()));
+        recycle(std::move(*data));
+    }
     return result;
 }
 
@@ -71,6 +139,194 @@ std::unique_ptr<std::vector<char>> Driver::tryGetBinary(std::string path) const
     return data;
 }
 
+std::vector<char> Driver::getRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    if (auto data = tryGetRange(path, offset, length)) return std::move(*data);
+    throw ArbiterError(
+        "Could not read range of file " + m_protocol + "://" + path);
+}
+
+std::unique_ptr<std::vector<char>> Driver::tryGetRange(
+        const std::string path,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    std::unique_ptr<std::vector<char>> data(new std::vector<char>());
+    if (length && !get(path, *data, offset, length)) data.reset();
+    return data;
+}
+
+std::vector<std::vector<char>> Driver::getRanges(
+        const std::string path,
+        const std::vector<ByteRange>& ranges,
+        const std::size_t gap) const
+{
+    std::vector<std::vector<char>> out(ranges.size());
+
+    std::vector<std::size_t> order;
+    for (std::size_t i(0); i < ranges.size(); ++i)
+    {
+        if (ranges[i].length) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&ranges](std::size_t a, std::size_t b)
+    {
+        return ranges[a].offset < ranges[b].offset;
+    });
+
+    // Spans of ranges to read at once, as [begin, end) indices into order.
+    // A range joins the current span if it starts within gap bytes of the
+    // furthest end so far.
+    std::vector<std::pair<std::size_t, std::size_t>> spans;
+    std::size_t end(0);
+    for (std::size_t k(0); k < order.size(); ++k)
+    {
+        const ByteRange& r(ranges[order[k]]);
+        if (spans.empty() || r.offset > end + gap)
+        {
+            spans.emplace_back(k, k);
+            end = 0;
+        }
+        spans.back().second = k + 1;
+        end = (std::max)(end, r.offset + r.length);
+    }
+
+    // Start every span before waiting on any, and wait on all of them even
+    // once one fails, since their reads may refer to this driver.
+    std::vector<std::future<std::vector<std::vector<char>>>> reads;
+    for (const auto& span : spans)
+    {
+        std::vector<ByteRange> group;
+        for (std::size_t k(span.first); k < span.second; ++k)
+        {
+            group.push_back(ranges[order[k]]);
+        }
+        reads.push_back(fetch(path, std::move(group)));
+    }
+
+    std::exception_ptr error;
+    for (std::size_t s(0); s < spans.size(); ++s)
+    {
+        try
+        {
+            auto data(reads[s].get());
+            for (std::size_t j(0); j < data.size(); ++j)
+            {
+                out[order[spans[s].first + j]] = std::move(data[j]);
+            }
+        }
+        catch (...)
+        {
+            if (!error) error = std::current_exception();
+        }
+    }
+    if (error) std::rethrow_exception(error);
+
+    return out;
+}
+
+std::unique_ptr<ReadStream> Driver::openRead(
+        const std::string path,
+        const std::size_t chunkSize,
+        const std::size_t depth) const
+{
+    return std::unique_ptr<ReadStream>(
+            new ReadStream(*this, path, chunkSize, depth));
+}
+
+std::unique_ptr<WriteStream> Driver::openWrite(
+        const std::string path,
+        const std::size_t partSize) const
+{
+    return std::unique_ptr<WriteStream>(
+            new WriteStream(upload(path, partSize), partSize));
+}
+
+std::unique_ptr<Upload> Driver::upload(
+        const std::string path,
+        const std::size_t /*partSize*/) const
+{
+    return std::unique_ptr<Upload>(new WholeUpload(*this, path));
+}
+
+bool Driver::get(
+        const std::string path,
+        const std::vector<ByteRange>& ranges,
+        std::vector<std::vector<char>>& data) const
+{
+    const std::size_t begin(ranges.front().offset);
+    std::size_t end(begin);
+    for (const ByteRange& r : ranges) end = (std::max)(end, r.offset + r.length);
+
+    std::vector<char> span;
+    if (!get(path, span, begin, end - begin)) return false;
+    return slice(std::move(span), begin, ranges, data);
+}
+
+std::future<std::vector<std::vector<char>>> Driver::fetch(
+        const std::string path,
+        const std::vector<ByteRange> ranges) const
+{
+    return spare([this, path, ranges]()
+    {
+        std::vector<std::vector<char>> data(ranges.size());
+        if (!get(path, ranges, data))
+        {
+            throw ArbiterError(
+                "Could not read ranges of file " + m_protocol + "://" + path);
+        }
+        return data;
+    });
+}
+
+std::future<std::vector<char>> Driver::fetch(const std::string path) const
+{
+    return spare([this, path]() { return getBinary(path); });
+}
+
+bool Driver::slice(
+        std::vector<char> span,
+        const std::size_t begin,
+        const std::vector<ByteRange>& ranges,
+        std::vector<std::vector<char>>& data) const
+{
+    if (ranges.size() == 1)
+    {
+        data.front() = std::move(span);
+        return true;
+    }
+
+    for (std::size_t i(0); i < ranges.size(); ++i)
+    {
+        const std::size_t offset(ranges[i].offset - begin);
+        if (offset >= span.size()) return false;
+
+        const auto from(span.begin() + offset);
+        data[i].assign(
+            from,
+            from + (std::min)(ranges[i].length, span.size() - offset));
+    }
+
+    recycle(std::move(span));
+    return true;
+}
+
+bool Driver::get(
+        const std::string path,
+        std::vector<char>& data,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    if (!get(path, data) || offset >= data.size()) return false;
+
+    const std::size_t end(offset + (std::min)(length, data.size() - offset));
+    data.erase(data.begin() + end, data.end());
+    data.erase(data.begin(), data.begin() + offset);
+    return true;
+}
+
 std::size_t Driver::getSize(const std::string path) const
 {
     if (auto size = tryGetSize(path)) return *size;
@@ -85,7 +341,9 @@ std::vector<char> Driver::put(std::string path, const std::string& data) const
 
 void Driver::copy(std::string src, std::string dst) const
 {
-    put(dst, getBinary(src));
+    std::vector<char> data(getBinary(src));
+    put(dst, data);
+    recycle(std::move(data));
 }
 
 std::vector<std::string> Driver::resolve(
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <future>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -20,6 +21,25 @@ namespace arbiter
 {
 namespace http { class Pool; }
 
+class ReadStream;
+class Upload;
+class WriteStream;
+
+/** A span of @p length bytes starting at byte @p offset of a file. */
+struct ByteRange
+{
+    std::size_t offset = 0;
+    std::size_t length = 0;
+};
+
+/** The outcome of one item of a batch operation like Arbiter::getMany. */
+struct BatchResult
+{
+    std::vector<char> data;     // The contents of the file, for reads.
+    std::string error;          // Empty on success.
+
+    bool ok() const { return error.empty(); }
+};
 
 /** @brief Base class for interacting with a storage type.
  *
@@ -70,6 +90,49 @@ public:
     /** Get binary data, if available. */
     std::unique_ptr<std::vector<char>> tryGetBinary(std::string path) const;
 
+    /** Get @p length bytes of binary data starting at byte @p offset.  The
+     * result is shorter than @p length if the file ends first.  Throws if
+     * the file can't be read or @p offset is not within it.
+     */
+    std::vector<char> getRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Get a range of binary data, if available.  See Driver::getRange. */
+    std::unique_ptr<std::vector<char>> tryGetRange(
+            std::string path,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Get several ranges of binary data, one result for each of
+     * @p ranges, as if by Driver::getRange.  Ranges separated by no more than
+     * @p gap bytes are read together, and the reads are all started at once
+     * with the priority and http::Cancellation of the calling thread, see
+     * Driver::fetch.  Throws if any of the ranges can't be read.
+     */
+    std::vector<std::vector<char>> getRanges(
+            std::string path,
+            const std::vector<ByteRange>& ranges,
+            std::size_t gap = 64 * 1024) const;
+
+    /** Open a seekable stream over the file, read in chunks of
+     * @p chunkSize bytes with @p depth chunks fetched ahead of the reader.
+     * See ReadStream.
+     */
+    std::unique_ptr<ReadStream> openRead(
+            std::string path,
+            std::size_t chunkSize = 1024 * 1024,
+            std::size_t depth = 4) const;
+
+    /** Open a stream which writes the file in parts of @p partSize bytes as
+     * data arrives, see WriteStream.  Some drivers constrain the part size,
+     * and throw here if it doesn't suit them.
+     */
+    std::unique_ptr<WriteStream> openWrite(
+            std::string path,
+            std::size_t partSize = 8 * 1024 * 1024) const;
+
     /**
      * Write @p data to the given @p path.
      *
@@ -109,6 +172,11 @@ public:
             bool verbose = false) const;
 
 protected:
+    // These read through Driver::fetch.
+    friend class Arbiter;
+    friend class Endpoint;
+    friend class ReadStream;
+
     /** @brief Resolve a wildcard path.
      *
      * This operation should return a non-recursive resolution of the files
@@ -133,6 +201,90 @@ protected:
      */
     virtual bool get(std::string path, std::vector<char>& data) const = 0;
 
+    /** Read a byte range, see Driver::getRange.  Never called with a
+     * @p length of zero.
+     *
+     * @note The default behavior reads the whole file and keeps the range,
+     * so derived classes should override this if they can read only the
+     * range itself.
+     *
+     * @param path Path with the type-specifying prefix information stripped.
+     * @param[out] data Empty vector in which to write resulting data.
+     */
+    virtual bool get(
+            std::string path,
+            std::vector<char>& data,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Read nearby @p ranges together, see Driver::getRanges.  The ranges
+     * are non-empty and sorted by offset, but may overlap.
+     *
+     * @note The default behavior reads from the first range to the end of
+     * the last with a single ranged read and slices the results out of it.
+     *
+     * @param path Path with the type-specifying prefix information stripped.
+     * @param[out] data One empty vector for each of @p ranges.
+     */
+    virtual bool get(
+            std::string path,
+            const std::vector<ByteRange>& ranges,
+            std::vector<std::vector<char>>& data) const;
+
+    /** Start reading nearby @p ranges together, as by the version of
+     * Driver::get above, with the priority and http::Cancellation of the
+     * calling thread.  Getting the result throws ArbiterError if the ranges
+     * can't be read.  The result must be waited for before the Driver is
+     * destroyed.
+     *
+     * @note The default behavior runs that get on a thread of its own while
+     * the shared limit of internal::acquireThreads allows, or otherwise once
+     * the result is waited for.  Derived classes which can read without
+     * blocking a thread should override this.
+     *
+     * @param path Path with the type-specifying prefix information stripped.
+     */
+    virtual std::future<std::vector<std::vector<char>>> fetch(
+            std::string path,
+            std::vector<ByteRange> ranges) const;
+
+    /** Start reading the whole file, as by Driver::getBinary, in the same
+     * way as the version above.
+     *
+     * @param path Path with the type-specifying prefix information stripped.
+     */
+    virtual std::future<std::vector<char>> fetch(std::string path) const;
+
+    /** Start an upload in parts of @p partSize bytes, see Driver::openWrite.
+     *
+     * @note The default behavior gathers the whole file in memory and writes
+     * it with Driver::put once finished, so derived classes should override
+     * this if they can upload in parts.
+     *
+     * @param path Path with the type-specifying prefix information stripped.
+     */
+    virtual std::unique_ptr<Upload> upload(
+            std::string path,
+            std::size_t partSize) const;
+
+    /** Hand back a buffer read by this driver once it is no longer needed,
+     * so that a later read may reuse its storage.
+     *
+     * @note The default behavior frees it.
+     */
+    virtual void recycle(std::vector<char> /*buffer*/) const { }
+
+    /** Cut each of @p ranges out of @p span, which was read from byte
+     * @p begin of the file, into @p data, as the default multi-range
+     * Driver::get does.  Returns false if a range starts past the end of
+     * @p span.
+     */
+    bool slice(
+            std::vector<char> span,
+            std::size_t begin,
+            const std::vector<ByteRange>& ranges,
+            std::vector<std::vector<char>>& data) const;
+
     const std::string m_profile;
     const std::string m_protocol;
 };
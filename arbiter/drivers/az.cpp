@@ -281,8 +281,8 @@ std::unique_ptr<std::size_t> AZ::tryGetSize(
 
     if (res->ok())
     {
-        const auto cl = findHeader(res->headers(), "Content-Length");
-        if (cl) return makeUnique<std::size_t>(std::stoull(*cl));
+        const auto cl = res->header("Content-Length");
+        if (cl) return makeUnique<std::size_t>(std::stoull(std::string(*cl)));
     }
 
     return std::unique_ptr<std::size_t>();
@@ -293,49 +293,47 @@ bool AZ::get(
         std::vector<char>& data,
         const Headers userHeaders,
         const Query query) const
+{
+    Response res(getResponse(rawPath, userHeaders, query));
+
+    if (res.ok())
+    {
+        data = res.data();
+        return true;
+    }
+    else
+    {
+        std::cout << res.code() << ": " << res.str() << std::endl;
+        return false;
+    }
+}
+
+Request AZ::getRequest(
+        const std::string rawPath,
+        const Headers userHeaders,
+        const Query query) const
 {
     Headers headers(m_config->baseHeaders());
     headers.insert(userHeaders.begin(), userHeaders.end());
 
     const Resource resource(m_config->baseUrl(), rawPath);
-    drivers::Http http(m_pool);
-
-    std::unique_ptr<Response> res;
 
     if (m_config->hasSasToken())
     {
         Query q = m_config->sasToken();
         q.insert(query.begin(), query.end());
-        res.reset(new Response(http.internalGet(resource.url(), headers, q)));
+        return Http::getRequest(resource.url(), headers, q);
     }
-    else
-    {
-        const ApiV1 ApiV1(
-                "GET",
-                resource,
-                m_config->authFields(),
-                query,
-                headers,
-                emptyVect);
 
-        res.reset(
-            new Response(
-                http.internalGet(
-                    resource.url(),
-                    ApiV1.headers(),
-                    ApiV1.query())));
-    }
+    const ApiV1 ApiV1(
+            "GET",
+            resource,
+            m_config->authFields(),
+            query,
+            headers,
+            emptyVect);
 
-    if (res->ok())
-    {
-        data = res->data();
-        return true;
-    }
-    else
-    {
-        std::cout << res->code() << ": " << res->str() << std::endl;
-        return false;
-    }
+    return Http::getRequest(resource.url(), ApiV1.headers(), ApiV1.query());
 }
 
 std::vector<char> AZ::put(
@@ -407,6 +405,129 @@ std::vector<char> AZ::put(
     return res.data();
 }
 
+// https://learn.microsoft.com/en-us/rest/api/storageservices/put-block
+class AZ::BlockUpload : public Upload
+{
+public:
+    BlockUpload(const AZ& az, const std::string path)
+        : m_az(az)
+        , m_path(path)
+        , m_resource(az.m_config->baseUrl(), path)
+    { }
+
+    void write(const std::vector<char>& data) override
+    {
+        if (m_ids.size() == maxBlocks)
+        {
+            throw ArbiterError(
+                    "Couldn't Azure upload to " + m_path + ": too many blocks");
+        }
+
+        // Block IDs must all be of the same length.  Nine digits encode to
+        // base64 without padding or characters needing to be escaped.
+        const std::string n(std::to_string(m_ids.size()));
+        const std::string id(
+                crypto::encodeBase64(std::string(9 - n.size(), '0') + n));
+
+        Query query;
+        query["comp"] = "block";
+        query["blockid"] = id;
+        send(data, Headers(), query);
+
+        m_ids.push_back(id);
+    }
+
+    void finish(const std::vector<char>& data) override
+    {
+        // A file of a single part doesn't need to be uploaded in blocks.
+        if (m_ids.empty())
+        {
+            m_az.put(m_path, data, Headers(), Query());
+            return;
+        }
+
+        if (data.size()) write(data);
+
+        std::string xml("<?xml version=\"1.0\" encoding=\"utf-8\"?><BlockList>");
+        for (const std::string& id : m_ids) xml += "<Latest>" + id + "</Latest>";
+        xml += "</BlockList>";
+
+        Headers headers;
+        if (getExtension(m_path) == "json")
+        {
+            headers["x-ms-blob-content-type"] = "application/json";
+        }
+
+        Query query;
+        query["comp"] = "blocklist";
+        send(std::vector<char>(xml.begin(), xml.end()), headers, query);
+    }
+
+private:
+    static constexpr std::size_t maxBlocks = 50000;
+
+    void send(
+            const std::vector<char>& data,
+            Headers headers,
+            const Query& query) const
+    {
+        drivers::Http http(m_az.m_pool);
+        std::unique_ptr<Response> res;
+
+        if (m_az.m_config->hasSasToken())
+        {
+            headers["Content-Length"] = std::to_string(data.size());
+
+            Query q = m_az.m_config->sasToken();
+            q.insert(query.begin(), query.end());
+
+            res.reset(
+                new Response(
+                    http.internalPut(m_resource.url(), data, headers, q)));
+        }
+        else
+        {
+            Headers h(m_az.m_config->baseHeaders());
+            h.insert(headers.begin(), headers.end());
+
+            const ApiV1 ApiV1(
+                    "PUT",
+                    m_resource,
+                    m_az.m_config->authFields(),
+                    query,
+                    h,
+                    data);
+
+            res.reset(
+                new Response(
+                    http.internalPut(
+                        m_resource.url(),
+                        data,
+                        ApiV1.headers(),
+                        ApiV1.query())));
+        }
+
+        if (!res->ok())
+        {
+            throw ArbiterError(
+                    "Couldn't Azure upload to " + m_path + ": " + res->str());
+        }
+    }
+
+    const AZ& m_az;
+    const std::string m_path;
+    const Resource m_resource;
+
+    std::vector<std::string> m_ids;
+};
+
+std::unique_ptr<Upload> AZ::upload(
+        const std::string path,
+        const std::size_t /*partSize*/) const
+{
+    return std::unique_ptr<Upload>(new BlockUpload(*this, path));
+}
+
 void AZ::copy(const std::string src, const std::string dst) const
 {
     Headers headers;
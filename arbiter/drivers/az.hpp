@@ -66,11 +66,25 @@ private:
             http::Headers headers,
             http::Query query) const override;
 
+    /** Inherited from Drivers::Http. */
+    virtual http::Request getRequest(
+            std::string path,
+            http::Headers headers,
+            http::Query query) const override;
+
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
+    /** Uploads each part as a block of a block blob, or with a single PUT
+     * for files of one part.
+     */
+    virtual std::unique_ptr<Upload> upload(
+            std::string path,
+            std::size_t partSize) const override;
+
     class ApiV1;
+    class BlockUpload;
     class Resource;
 
     std::unique_ptr<Config> m_config;
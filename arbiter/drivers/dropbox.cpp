@@ -142,26 +142,21 @@ bool Dropbox::get(
         const Headers userHeaders,
         const Query query) const
 {
-    Headers headers(httpGetHeaders());
-
-    headers["Dropbox-API-Arg"] = json{{ "path", "/" + path }}.dump();
-    headers.insert(userHeaders.begin(), userHeaders.end());
-
-    Response res(Http::internalGet(getUrl, headers, query));
+    Response res(getResponse(path, userHeaders, query));
 
     if (res.ok())
     {
         if (!userHeaders.count("Range"))
         {
-            Headers headers = res.headers();
-            if (!headers.count("dropbox-api-result"))
+            const auto result = res.header("dropbox-api-result");
+            if (!result)
             {
                 std::cout << "No dropbox-api-result header found" << std::endl;
                 return false;
             }
 
             json rx;
-            try { rx = json::parse(headers.at("dropbox-api-result")); }
+            try { rx = json::parse(*result); }
             catch (...) { std::cout << "Failed to parse result" << std::endl; }
 
             if (!rx.is_null())
@@ -204,6 +199,24 @@ bool Dropbox::get(
     return false;
 }
 
+std::future<std::vector<char>> Dropbox::fetch(const std::string path) const
+{
+    return Driver::fetch(path);
+}
+
+Request Dropbox::getRequest(
+        const std::string path,
+        const Headers userHeaders,
+        const Query query) const
+{
+    Headers headers(httpGetHeaders());
+
+    headers["Dropbox-API-Arg"] = json{{ "path", "/" + path }}.dump();
+    headers.insert(userHeaders.begin(), userHeaders.end());
+
+    return Http::getRequest(getUrl, headers, query);
+}
+
 std::vector<char> Dropbox::put(
         const std::string path,
         const std::vector<char>& data,
@@ -59,6 +59,16 @@ private:
             http::Headers headers,
             http::Query query) const override;
 
+    virtual http::Request getRequest(
+            std::string path,
+            http::Headers headers,
+            http::Query query) const override;
+
+    // Whole files are checked against their size, see Dropbox::get.
+    using Http::fetch;
+    virtual std::future<std::vector<char>> fetch(
+            std::string path) const override;
+
     virtual std::unique_ptr<std::size_t> tryGetSize(
             std::string path) const override;
 
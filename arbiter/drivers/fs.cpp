@@ -5,8 +5,11 @@
 #endif
 
 #ifndef ARBITER_WINDOWS
+#include <fcntl.h>
 #include <glob.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #else
 #define UNICODE
 #include <shlwapi.h>
@@ -18,6 +21,9 @@
 #endif
 
 #include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <ios>
@@ -61,6 +67,105 @@ namespace
 
         return s;
     }
+
+    class FsUpload : public Upload
+    {
+    public:
+        explicit FsUpload(std::string path)
+            : m_path(expandTilde(path))
+            , m_temp(m_path + ".arbiter-" + std::to_string(randomNumber()))
+        {
+#ifndef ARBITER_WINDOWS
+            m_fd = ::open(
+                    m_temp.c_str(),
+                    O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                    0666);
+            if (m_fd < 0)
+#else
+            m_stream.open(m_temp, binaryTruncMode);
+            if (!m_stream.good())
+#endif
+            {
+                throw ArbiterError("Could not open " + m_path + " for writing");
+            }
+        }
+
+        ~FsUpload()
+        {
+            if (m_done) return;
+#ifndef ARBITER_WINDOWS
+            if (m_fd >= 0) ::close(m_fd);
+#else
+            m_stream.close();
+#endif
+            ::remove(m_temp.c_str());
+        }
+
+        void write(const std::vector<char>& data) override
+        {
+#ifndef ARBITER_WINDOWS
+            std::size_t done(0);
+            while (done < data.size())
+            {
+                const auto n = ::write(
+                        m_fd,
+                        data.data() + done,
+                        data.size() - done);
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) fail();
+                done += static_cast<std::size_t>(n);
+            }
+#else
+            m_stream.write(data.data(), data.size());
+            if (!m_stream.good()) fail();
+#endif
+        }
+
+        void finish(const std::vector<char>& data) override
+        {
+            write(data);
+
+#ifndef ARBITER_WINDOWS
+            const int err(::close(m_fd));
+            m_fd = -1;
+            if (err) fail();
+
+            if (::rename(m_temp.c_str(), m_path.c_str()) != 0)
+#else
+            m_stream.close();
+            if (m_stream.fail()) fail();
+
+            std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+            const std::wstring temp(converter.from_bytes(m_temp));
+            const std::wstring path(converter.from_bytes(m_path));
+            if (!::MoveFileExW(
+                        temp.c_str(),
+                        path.c_str(),
+                        MOVEFILE_REPLACE_EXISTING))
+#endif
+            {
+                throw ArbiterError("Could not move " + m_temp + " to " + m_path);
+            }
+
+            m_done = true;
+        }
+
+    private:
+        void fail() const
+        {
+            throw ArbiterError("Error occurred while writing " + m_path);
+        }
+
+        const std::string m_path;
+        const std::string m_temp;
+        bool m_done = false;
+
+#ifndef ARBITER_WINDOWS
+        int m_fd = -1;
+#else
+        std::ofstream m_stream;
+#endif
+    };
 }
 
 namespace drivers
@@ -108,6 +213,159 @@ bool Fs::get(std::string path, std::vector<char>& data) const
     return good;
 }
 
+bool Fs::get(
+        std::string path,
+        std::vector<char>& data,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    path = expandTilde(path);
+
+#ifndef ARBITER_WINDOWS
+    const int fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || offset >= static_cast<std::size_t>(st.st_size))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    data.resize((std::min)(length, static_cast<std::size_t>(st.st_size) - offset));
+
+    // A short read just means the file shrank underneath us.
+    std::size_t done(0);
+    while (done < data.size())
+    {
+        const auto n = ::pread(
+                fd,
+                data.data() + done,
+                data.size() - done,
+                static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) break;
+        done += static_cast<std::size_t>(n);
+    }
+
+    ::close(fd);
+    data.resize(done);
+    return true;
+#else
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream.good()) return false;
+
+    stream.seekg(0, std::ios::end);
+    const std::size_t size(static_cast<std::size_t>(stream.tellg()));
+    if (offset >= size) return false;
+
+    data.resize((std::min)(length, size - offset));
+    stream.seekg(offset, std::ios::beg);
+    stream.read(data.data(), data.size());
+    data.resize(static_cast<std::size_t>(stream.gcount()));
+    return true;
+#endif
+}
+
+bool Fs::get(
+        std::string path,
+        const std::vector<ByteRange>& ranges,
+        std::vector<std::vector<char>>& data) const
+{
+#ifndef ARBITER_WINDOWS
+    for (std::size_t i(1); i < ranges.size(); ++i)
+    {
+        const ByteRange& prev(ranges[i - 1]);
+        if (ranges[i].offset < prev.offset + prev.length)
+        {
+            return Driver::get(path, ranges, data);
+        }
+    }
+
+    const int fd(::open(expandTilde(path).c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    const std::size_t size(st.st_size);
+
+    // Size the results, clipped to the end of the file, along with the gap
+    // before each of them.
+    std::vector<std::size_t> gaps(ranges.size(), 0);
+    for (std::size_t i(0); i < ranges.size(); ++i)
+    {
+        const ByteRange& r(ranges[i]);
+        if (r.offset >= size)
+        {
+            ::close(fd);
+            return false;
+        }
+        if (i) gaps[i] = r.offset - ranges[i - 1].offset - data[i - 1].size();
+        data[i].resize((std::min)(r.length, size - r.offset));
+    }
+
+    // Scatter the span into the results, and the gaps between them into a
+    // scratch buffer whose contents are discarded.
+    std::vector<char> scratch(*std::max_element(gaps.begin(), gaps.end()));
+    std::vector<iovec> iov;
+    for (std::size_t i(0); i < ranges.size(); ++i)
+    {
+        if (gaps[i]) iov.push_back(iovec{ scratch.data(), gaps[i] });
+        iov.push_back(iovec{ data[i].data(), data[i].size() });
+    }
+
+    off_t at(ranges.front().offset);
+    std::size_t k(0);
+    while (k < iov.size())
+    {
+        const auto n = ::preadv(
+                fd,
+                &iov[k],
+                static_cast<int>((std::min<std::size_t>)(iov.size() - k, IOV_MAX)),
+                at);
+        if (n < 0 && errno == EINTR) continue;
+
+        // Either an error or the file shrank underneath us.
+        if (n <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        // Skip past the buffers filled, and trim a partially filled one.
+        at += n;
+        std::size_t left(n);
+        while (left && left >= iov[k].iov_len) left -= iov[k++].iov_len;
+        if (left)
+        {
+            iov[k].iov_base = static_cast<char*>(iov[k].iov_base) + left;
+            iov[k].iov_len -= left;
+        }
+    }
+
+    ::close(fd);
+    return true;
+#else
+    return Driver::get(path, ranges, data);
+#endif
+}
+
+std::unique_ptr<Upload> Fs::upload(
+        const std::string path,
+        const std::size_t /*partSize*/) const
+{
+    return std::unique_ptr<Upload>(new FsUpload(path));
+}
+
 std::vector<char> Fs::put(std::string path, const std::vector<char>& data) const
 {
     path = expandTilde(path);
@@ -5,6 +5,7 @@
 #endif
 
 #ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/stream.hpp>
 #include <arbiter/util/exports.hpp>
 #endif
 
@@ -117,6 +118,28 @@ public:
 
 protected:
     virtual bool get(std::string path, std::vector<char>& data) const override;
+
+    /** Reads only the range, with `pread` where available. */
+    virtual bool get(
+            std::string path,
+            std::vector<char>& data,
+            std::size_t offset,
+            std::size_t length) const override;
+
+    /** Reads the ranges straight into their results with `preadv`, where
+     * available and the ranges don't overlap.
+     */
+    virtual bool get(
+            std::string path,
+            const std::vector<ByteRange>& ranges,
+            std::vector<std::vector<char>>& data) const override;
+
+    /** Writes the parts to a temporary file beside @p path as they arrive,
+     * which is renamed into place once finished.
+     */
+    virtual std::unique_ptr<Upload> upload(
+            std::string path,
+            std::size_t partSize) const override;
 };
 
 } // namespace drivers
@@ -102,7 +102,7 @@ std::unique_ptr<Google> Google::create(
     const std::string s,
     const std::string profile)
 {
-    if (auto auth = Auth::create(s))
+    if (auto auth = Auth::create(pool, s))
     {
         return makeUnique<Google>(pool, std::move(auth), profile);
     }
@@ -120,8 +120,8 @@ std::unique_ptr<std::size_t> Google::tryGetSize(const std::string path) const
 
     if (res.ok())
     {
-        const auto cl = findHeader(res.headers(), "Content-Length");
-        if (cl) return makeUnique<std::size_t>(std::stoull(*cl));
+        const auto cl = res.header("Content-Length");
+        if (cl) return makeUnique<std::size_t>(std::stoull(std::string(*cl)));
     }
 
     return std::unique_ptr<std::size_t>();
@@ -131,15 +131,9 @@ bool Google::get(
         const std::string path,
         std::vector<char>& data,
         const http::Headers userHeaders,
-        const http::Query /*query*/) const
+        const http::Query query) const
 {
-    http::Headers headers(m_auth->headers());
-    headers.insert(userHeaders.begin(), userHeaders.end());
-    const GResource resource(path);
-
-    drivers::Https https(m_pool);
-    http::Response res(
-            https.internalGet(resource.endpoint(), headers, altMediaQuery));
+    http::Response res(getResponse(path, userHeaders, query));
 
     if (res.ok())
     {
@@ -154,6 +148,18 @@ bool Google::get(
     }
 }
 
+http::Request Google::getRequest(
+        const std::string path,
+        const http::Headers userHeaders,
+        const http::Query /*query*/) const
+{
+    http::Headers headers(m_auth->headers());
+    headers.insert(userHeaders.begin(), userHeaders.end());
+    const GResource resource(path);
+
+    return Https::getRequest(resource.endpoint(), headers, altMediaQuery);
+}
+
 std::vector<char> Google::put(
         const std::string path,
         const std::vector<char>& data,
@@ -178,6 +184,103 @@ std::vector<char> Google::put(
     return res.data();
 }
 
+// https://cloud.google.com/storage/docs/performing-resumable-uploads
+class Google::ResumableUpload : public Upload
+{
+public:
+    ResumableUpload(const Google& google, const std::string path)
+        : m_google(google)
+        , m_path(path)
+    { }
+
+    void write(const std::vector<char>& data) override
+    {
+        if (m_session.empty()) start();
+        send(data, "*");
+    }
+
+    void finish(const std::vector<char>& data) override
+    {
+        // A file of a single part doesn't need an upload session.
+        if (m_session.empty())
+        {
+            m_google.put(m_path, data, http::Headers(), http::Query());
+            return;
+        }
+
+        send(data, std::to_string(m_offset + data.size()));
+    }
+
+private:
+    void start()
+    {
+        const GResource resource(m_path);
+
+        http::Query query;
+        query["uploadType"] = "resumable";
+        query["name"] = http::sanitize(resource.object(), GResource::exclusions);
+
+        drivers::Https https(m_google.m_pool);
+        http::Response res(
+                https.internalPost(
+                    resource.uploadEndpoint(),
+                    std::vector<char>(),
+                    m_google.m_auth->headers(),
+                    query));
+
+        const auto location(res.header("Location"));
+        if (!res.ok() || !location)
+        {
+            throw ArbiterError(
+                    "Couldn't start Google upload to " + m_path + ": " +
+                    res.str());
+        }
+        m_session = std::string(*location);
+    }
+
+    // Continue the upload with @p data, where @p total is the size of the
+    // whole file, or "*" while that isn't known yet.
+    void send(const std::vector<char>& data, const std::string total)
+    {
+        http::Headers headers(m_google.m_auth->headers());
+        headers["Expect"] = "";
+        headers["Content-Range"] = data.empty() ?
+            "bytes */" + total :
+            "bytes " + std::to_string(m_offset) + "-" +
+                std::to_string(m_offset + data.size() - 1) + "/" + total;
+
+        drivers::Https https(m_google.m_pool);
+        http::Response res(https.internalPut(m_session, data, headers));
+
+        // A 308 acknowledges a part of an upload which isn't finished.
+        if (!res.ok() && res.code() != 308)
+        {
+            throw ArbiterError(
+                    "Couldn't Google upload to " + m_path + ": " + res.str());
+        }
+
+        m_offset += data.size();
+    }
+
+    const Google& m_google;
+    const std::string m_path;
+
+    std::string m_session;
+    std::size_t m_offset = 0;
+};
+
+std::unique_ptr<Upload> Google::upload(
+        const std::string path,
+        const std::size_t partSize) const
+{
+    if (partSize % (256 * 1024))
+    {
+        throw ArbiterError("Google upload parts must be a multiple of 256 KiB");
+    }
+
+    return std::unique_ptr<Upload>(new ResumableUpload(*this, path));
+}
+
 std::vector<std::string> Google::glob(std::string path, bool /*verbose*/) const
 {
     std::vector<std::string> results;
@@ -224,7 +327,9 @@ std::vector<std::string> Google::glob(std::string path, bool /*verbose*/) const
 
 ///////////////////////////////////////////////////////////////////////////////
 
-std::unique_ptr<Google::Auth> Google::Auth::create(const std::string s)
+std::unique_ptr<Google::Auth> Google::Auth::create(
+        http::Pool& pool,
+        const std::string s)
 {
     const json j(json::parse(s));
     if (auto path = env("GOOGLE_APPLICATION_CREDENTIALS"))
@@ -233,7 +338,7 @@ std::unique_ptr<Google::Auth> Google::Auth::create(const std::string s)
         {
             try
             {
-                return makeUnique<Auth>(*file);
+                return makeUnique<Auth>(pool, *file);
             }
             catch (const ArbiterError& e)
             {
@@ -247,19 +352,20 @@ std::unique_ptr<Google::Auth> Google::Auth::create(const std::string s)
         const auto path(j.get<std::string>());
         if (const auto file = drivers::Fs().tryGet(path))
         {
-            return makeUnique<Auth>(*file);
+            return makeUnique<Auth>(pool, *file);
         }
     }
     else if (j.is_object())
     {
-        return makeUnique<Auth>(s);
+        return makeUnique<Auth>(pool, s);
     }
 
     return std::unique_ptr<Auth>();
 }
 
-Google::Auth::Auth(const std::string s)
-    : m_clientEmail(json::parse(s).at("client_email").get<std::string>())
+Google::Auth::Auth(http::Pool& pool, const std::string s)
+    : m_pool(pool)
+    , m_clientEmail(json::parse(s).at("client_email").get<std::string>())
     , m_privateKey(json::parse(s).at("private_key").get<std::string>())
 {
     maybeRefresh();
@@ -305,8 +411,7 @@ void Google::Auth::maybeRefresh() const
     const http::Headers headers { { "Expect", "" } };
     const std::string tokenRequestUrl("www.googleapis.com/oauth2/v4/token");
 
-    http::Pool pool;
-    drivers::Https https(pool);
+    drivers::Https https(m_pool);
     http::Response res(https.internalPost(tokenRequestUrl, body, headers));
 
     if (!res.ok())
@@ -50,18 +50,34 @@ private:
             http::Headers headers,
             http::Query query) const override;
 
+    /** Inherited from Drivers::Http. */
+    virtual http::Request getRequest(
+            std::string path,
+            http::Headers headers,
+            http::Query query) const override;
+
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
+    /** Uploads with a resumable upload session, or a single request for
+     * files of one part.  Parts must be a multiple of 256 KiB.
+     */
+    virtual std::unique_ptr<Upload> upload(
+            std::string path,
+            std::size_t partSize) const override;
+
+    class ResumableUpload;
+
     std::unique_ptr<Auth> m_auth;
 };
 
 class Google::Auth
 {
 public:
-    Auth(std::string s);
-    static std::unique_ptr<Auth> create(std::string s);
+    // Token requests go through @p pool, which must outlive the Auth.
+    Auth(http::Pool& pool, std::string s);
+    static std::unique_ptr<Auth> create(http::Pool& pool, std::string s);
 
     http::Headers headers() const;
 
@@ -69,6 +85,7 @@ private:
     void maybeRefresh() const;
     std::string sign(std::string data, std::string privateKey) const;
 
+    http::Pool& m_pool;
     const std::string m_clientEmail;
     const std::string m_privateKey;
     mutable int64_t m_expiration = 0;   // Unix time.
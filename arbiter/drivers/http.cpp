@@ -11,7 +11,9 @@
 
 #include <algorithm>
 #include <cstring>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -29,6 +31,17 @@ namespace drivers
 
 using namespace http;
 
+namespace
+{
+    Headers rangeHeaders(const std::size_t offset, const std::size_t length)
+    {
+        Headers headers;
+        headers["Range"] = "bytes=" + std::to_string(offset) + "-" +
+            std::to_string(offset + length - 1);
+        return headers;
+    }
+}
+
 Http::Http(
         Pool& pool,
         const std::string driverProtocol,
@@ -72,8 +85,8 @@ std::unique_ptr<std::size_t> Http::tryGetSize(
 
     if (res.ok())
     {
-        const auto cl = findHeader(res.headers(), "Content-Length");
-        if (cl) return makeUnique<std::size_t>(std::stoull(*cl));
+        const auto cl = res.header("Content-Length");
+        if (cl) return makeUnique<std::size_t>(std::stoull(std::string(*cl)));
     }
 
     return std::unique_ptr<std::size_t>();
@@ -84,8 +97,10 @@ std::string Http::get(
         Headers headers,
         Query query) const
 {
-    const auto data(getBinary(path, headers, query));
-    return std::string(data.begin(), data.end());
+    auto data(getBinary(path, headers, query));
+    std::string result(data.begin(), data.end());
+    recycle(std::move(data));
+    return result;
 }
 
 std::unique_ptr<std::string> Http::tryGet(
@@ -95,7 +110,11 @@ std::unique_ptr<std::string> Http::tryGet(
 {
     std::unique_ptr<std::string> result;
     auto data(tryGetBinary(path, headers, query));
-    if (data) result.reset(new std::string(data->begin(), data->end()));
+    if (data)
+    {
+        result.reset(new std::string(data->begin(), data->end()));
+        recycle(std::move(*data));
+    }
     return result;
 }
 
@@ -127,6 +146,26 @@ std::unique_ptr<std::vector<char>> Http::tryGetBinary(
     return data;
 }
 
+std::size_t Http::stream(
+        const std::string path,
+        http::Sink sink,
+        const Headers headers,
+        const Query query) const
+{
+    Response res(m_pool.acquire().get(
+        typedPath(path),
+        std::move(sink),
+        headers,
+        query));
+
+    if (!res.ok())
+    {
+        throw ArbiterError("Could not stream from '" + path + "'");
+    }
+
+    return res.delivered();
+}
+
 std::vector<char> Http::put(
         std::string path,
         const std::string& data,
@@ -146,13 +185,132 @@ bool Http::get(
         const Headers headers,
         const Query query) const
 {
-    Resource http(m_pool.acquire());
-    Response res(http.get(typedPath(path), headers, query));
+    Response res(getResponse(path, headers, query));
 
+    // Moves the body out of the response.
     data = res.data();
     return res.ok();
 }
 
+Request Http::getRequest(
+        const std::string path,
+        const Headers headers,
+        const Query query) const
+{
+    Request req;
+    req.path = typedPath(path);
+    req.headers = headers;
+    req.query = query;
+    return req;
+}
+
+Response Http::getResponse(
+        const std::string path,
+        const Headers headers,
+        const Query query) const
+{
+    Request req(getRequest(path, headers, query));
+    req.priority = PriorityScope::current();
+    req.cancel = CancellationScope::current();
+    return m_pool.submit(std::move(req)).get();
+}
+
+std::future<std::vector<std::vector<char>>> Http::fetch(
+        const std::string path,
+        const std::vector<ByteRange> ranges) const
+{
+    const std::size_t begin(ranges.front().offset);
+    std::size_t end(begin);
+    for (const ByteRange& r : ranges) end = (std::max)(end, r.offset + r.length);
+
+    Request req(getRequest(path, rangeHeaders(begin, end - begin), Query()));
+    req.priority = PriorityScope::current();
+    req.cancel = CancellationScope::current();
+
+    using Data = std::vector<std::vector<char>>;
+    auto promise(std::make_shared<std::promise<Data>>());
+    std::future<Data> future(promise->get_future());
+
+    m_pool.submit(std::move(req), [this, promise, path, ranges, begin, end](
+                Response res)
+    {
+        std::vector<char> span;
+        Data data(ranges.size());
+        if (range(res, span, begin, end - begin) &&
+            slice(std::move(span), begin, ranges, data))
+        {
+            promise->set_value(std::move(data));
+        }
+        else
+        {
+            promise->set_exception(std::make_exception_ptr(ArbiterError(
+                "Could not read ranges of file " + m_protocol + "://" + path)));
+        }
+    });
+
+    return future;
+}
+
+std::future<std::vector<char>> Http::fetch(const std::string path) const
+{
+    Request req(getRequest(path, Headers(), Query()));
+    req.priority = PriorityScope::current();
+    req.cancel = CancellationScope::current();
+
+    auto promise(std::make_shared<std::promise<std::vector<char>>>());
+    std::future<std::vector<char>> future(promise->get_future());
+
+    m_pool.submit(std::move(req), [this, promise, path](Response res)
+    {
+        if (res.ok()) promise->set_value(res.data());
+        else
+        {
+            promise->set_exception(std::make_exception_ptr(ArbiterError(
+                "Could not read file " + m_protocol + "://" + path)));
+        }
+    });
+
+    return future;
+}
+
+bool Http::get(
+        const std::string path,
+        std::vector<char>& data,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    Response res(getResponse(path, rangeHeaders(offset, length), Query()));
+    return range(res, data, offset, length);
+}
+
+bool Http::range(
+        Response& res,
+        std::vector<char>& data,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    if (!res.ok()) return false;
+
+    data = res.data();
+    if (res.code() == 206 || res.header("Content-Range")) return true;
+
+    // A server which ignores the Range header sends the whole file, so cut
+    // the range out of it ourselves.
+    std::vector<char> whole(std::move(data));
+    data.clear();
+    if (offset >= whole.size()) return false;
+
+    const auto from(whole.begin() + offset);
+    data.assign(from, from + (std::min)(length, whole.size() - offset));
+    recycle(std::move(whole));
+    return true;
+}
+
+void Http::recycle(std::vector<char> buffer) const
+{
+    m_pool.recycle(std::move(buffer));
+}
+
 std::vector<char> Http::put(
         const std::string path,
         const std::vector<char>& data,
@@ -200,8 +358,10 @@ Response Http::internalGet(
         const Query query,
         const std::size_t reserve,
         const int retry,
-        const std::size_t timeout) const
+        const std::size_t timeout,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return m_pool.acquire().get(
         typedPath(path),
         headers,
@@ -217,8 +377,10 @@ Response Http::internalPut(
         const Headers headers,
         const Query query,
         const int retry,
-        const std::size_t timeout) const
+        const std::size_t timeout,
+        const std::optional<http::Priority> priority) const
 {
+    const http::PriorityScope scope(priority);
     return m_pool.acquire().put(
         typedPath(path),
         data,
@@ -249,6 +411,14 @@ Response Http::internalPost(
     return m_pool.acquire().post(typedPath(path), data, headers, query);
 }
 
+Response Http::internalDelete(
+        const std::string path,
+        const Headers headers,
+        const Query query) const
+{
+    return m_pool.acquire().del(typedPath(path), headers, query);
+}
+
 std::string Http::typedPath(const std::string& p) const
 {
     if (getProtocol(p) != "file") return p;
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <optional>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/driver.hpp>
@@ -93,6 +94,19 @@ public:
             http::Headers headers,
             http::Query query) const;
 
+    /** Perform an HTTP GET request, handing the body to @p sink in pieces as
+     * it arrives so that objects of any size may be consumed in bounded
+     * memory.  See http::fdSink and http::bufferSink for common sinks.
+     *
+     * @return The number of bytes delivered to @p sink.
+     * @throws ArbiterError if the request fails or @p sink stops it.
+     */
+    std::size_t stream(
+            std::string path,
+            http::Sink sink,
+            http::Headers headers = http::Headers(),
+            http::Query query = http::Query()) const;
+
     /** Perform an HTTP PUT request. */
     std::vector<char> put(
             std::string path,
@@ -123,7 +137,8 @@ public:
             http::Query query) const;
 
     /* These operations are other HTTP-specific calls that derived drivers may
-     * need for their underlying API use.
+     * need for their underlying API use.  Without a @p priority, requests
+     * have that of the calling thread, see http::PriorityScope.
      */
     http::Response internalGet(
             std::string path,
@@ -131,7 +146,8 @@ public:
             http::Query query = http::Query(),
             std::size_t reserve = 0,
             int retry = -1,
-            std::size_t timeout = 0) const;
+            std::size_t timeout = 0,
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     http::Response internalPut(
             std::string path,
@@ -139,7 +155,8 @@ public:
             http::Headers headers = http::Headers(),
             http::Query query = http::Query(),
             int retry = -1,
-            std::size_t timeout = 0) const;
+            std::size_t timeout = 0,
+            std::optional<http::Priority> priority = std::nullopt) const;
 
     http::Response internalHead(
             std::string path,
@@ -152,6 +169,11 @@ public:
             http::Headers headers = http::Headers(),
             http::Query query = http::Query()) const;
 
+    http::Response internalDelete(
+            std::string path,
+            http::Headers headers = http::Headers(),
+            http::Query query = http::Query()) const;
+
 protected:
     /** HTTP-derived Drivers should override this version of GET to allow for
      * custom headers and query parameters.
@@ -162,6 +184,38 @@ protected:
             http::Headers headers,
             http::Query query) const;
 
+    /** Build the GET request behind the version above, which by default is
+     * built on this one.  HTTP-derived Drivers which sign or redirect their
+     * requests should override this too, since ranged reads are built with
+     * it directly.  The priority and http::Cancellation are filled in when
+     * the request is sent.
+     */
+    virtual http::Request getRequest(
+            std::string path,
+            http::Headers headers,
+            http::Query query) const;
+
+    /** Send the request built by getRequest and return the whole response,
+     * so that its status and headers may be checked.
+     */
+    http::Response getResponse(
+            std::string path,
+            http::Headers headers,
+            http::Query query) const;
+
+    /** Submits the request for the ranges to the http::Pool, so that no
+     * thread waits on it.
+     */
+    virtual std::future<std::vector<std::vector<char>>> fetch(
+            std::string path,
+            std::vector<ByteRange> ranges) const override;
+
+    virtual std::future<std::vector<char>> fetch(
+            std::string path) const override;
+
+    /** Returns the buffer to the http::Pool for a later response. */
+    virtual void recycle(std::vector<char> buffer) const override;
+
     http::Pool& m_pool;
     std::string m_httpProtocol;
 
@@ -173,6 +227,21 @@ private:
         return get(path, data, http::Headers(), http::Query());
     }
 
+    // Passes a Range header to Http::getResponse.
+    virtual bool get(
+            std::string path,
+            std::vector<char>& data,
+            std::size_t offset,
+            std::size_t length) const final override;
+
+    // Take the @p length bytes at @p offset out of @p res, the response to a
+    // request for them, into @p data.
+    bool range(
+            http::Response& res,
+            std::vector<char>& data,
+            std::size_t offset,
+            std::size_t length) const;
+
     std::string typedPath(const std::string& p) const;
 };
 
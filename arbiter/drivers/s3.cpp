@@ -141,12 +141,13 @@ std::unique_ptr<S3> S3::create(
         if (auto p = env("AWS_PROFILE")) profile = *p;
     }
 
-    auto auth(doSignRequests() ? Auth::create(s, profile) : nullptr);
+    auto auth(doSignRequests() ? Auth::create(pool, s, profile) : nullptr);
     auto config = makeUnique<Config>(s, profile);
     return makeUnique<S3>(pool, profile, std::move(auth), std::move(config));
 }
 
 std::unique_ptr<S3::Auth> S3::Auth::create(
+    Pool& pool,
     const std::string s,
     const std::string profile)
 {
@@ -158,6 +159,7 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
             (config.count("secret") || config.count("hidden")))
     {
         return makeUnique<Auth>(
+                pool,
                 config["access"].get<std::string>(),
                 config.count("secret") ?
                     config["secret"].get<std::string>() :
@@ -174,7 +176,7 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
 
         if (access && hidden)
         {
-            return makeUnique<Auth>(*access, *hidden, token ? *token : "");
+            return makeUnique<Auth>(pool, *access, *hidden, token ? *token : "");
         }
 
         access = env("AMAZON_ACCESS_KEY_ID");
@@ -183,7 +185,7 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
 
         if (access && hidden)
         {
-            return makeUnique<Auth>(*access, *hidden, token ? *token : "");
+            return makeUnique<Auth>(pool, *access, *hidden, token ? *token : "");
         }
     }
 
@@ -209,14 +211,13 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
                 if (section.count(tokenKey))
                 {
                     const auto token(section.at(tokenKey));
-                    return makeUnique<Auth>(access, hidden, token);
+                    return makeUnique<Auth>(pool, access, hidden, token);
                 }
-                return makeUnique<Auth>(access, hidden);
+                return makeUnique<Auth>(pool, access, hidden);
            }
         }
     }
 
-    http::Pool pool;
     drivers::Http httpDriver(pool);
 
     // Nothing found in the environment or on the filesystem.  However we may
@@ -267,7 +268,7 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
                     throw ArbiterError("Failed to assume role with web identity");
                 }
 
-                return makeUnique<Auth>(stsAssumeRoleWithWebIdentityUrl, ReauthMethod::ASSUME_ROLE_WITH_WEB_IDENTITY);
+                return makeUnique<Auth>(pool, stsAssumeRoleWithWebIdentityUrl, ReauthMethod::ASSUME_ROLE_WITH_WEB_IDENTITY);
             }
         }
         catch (...) { }
@@ -312,7 +313,7 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
         if (!iamRole.empty())
         {
             const ReauthMethod reauthMethod = !token.empty() ? ReauthMethod::IMDS_V2 : ReauthMethod::IMDS_V1;
-            return makeUnique<Auth>(ec2CredBase + "/" + iamRole, reauthMethod);
+            return makeUnique<Auth>(pool, ec2CredBase + "/" + iamRole, reauthMethod);
         }
     }
     catch (...) { }
@@ -321,7 +322,7 @@ std::unique_ptr<S3::Auth> S3::Auth::create(
     // different IP.
     if (const auto relUri = env("AWS_CONTAINER_CREDENTIALS_RELATIVE_URI"))
     {
-        return makeUnique<Auth>(fargateCredIp + "/" + *relUri, ReauthMethod::IMDS_V2);
+        return makeUnique<Auth>(pool, fargateCredIp + "/" + *relUri, ReauthMethod::IMDS_V2);
     }
 
     return std::unique_ptr<Auth>();
@@ -483,8 +484,7 @@ S3::AuthFields S3::Auth::fields() const
         const Time now;
         if (!m_expiration || *m_expiration - now < reauthSeconds)
         {
-            http::Pool pool;
-            drivers::Http httpDriver(pool);
+            drivers::Http httpDriver(m_pool);
 
             std::string token;
 
@@ -614,8 +614,8 @@ std::unique_ptr<std::size_t> S3::tryGetSize(
 
     if (res.ok())
     {
-        const auto cl = findHeader(res.headers(), "Content-Length");
-        if (cl) return makeUnique<std::size_t>(std::stoull(*cl));
+        const auto cl = res.header("Content-Length");
+        if (cl) return makeUnique<std::size_t>(std::stoull(std::string(*cl)));
     }
 
     return std::unique_ptr<std::size_t>();
@@ -626,6 +626,28 @@ bool S3::get(
         std::vector<char>& data,
         const Headers userHeaders,
         const Query query) const
+{
+    Response res(getResponse(rawPath, userHeaders, query));
+    data = res.data();
+
+    if (res.ok())
+    {
+        return true;
+    }
+
+    if (isVerbose())
+    {
+        std::cout << res.code() << ": " <<
+            std::string(data.data(), data.size()) << std::endl;
+    }
+
+    return false;
+}
+
+Request S3::getRequest(
+        const std::string rawPath,
+        const Headers userHeaders,
+        const Query query) const
 {
     Headers headers(m_config->baseHeaders());
     headers.erase("x-amz-server-side-encryption");
@@ -645,24 +667,9 @@ bool S3::get(
             headers,
             empty);
 
-    drivers::Http http(m_pool);
-    Response res(
-            http.internalGet(
-                resource.url(),
-                apiV4.headers(),
-                apiV4.query(),
-                size ? *size : 0));
-
-    data = res.data();
-
-    if (res.ok())
-    {
-        return true;
-    }
-
-    if (isVerbose()) std::cout << res.code() << ": " << res.str() << std::endl;
-
-    return false;
+    Request req(Http::getRequest(resource.url(), apiV4.headers(), apiV4.query()));
+    req.reserve = size ? *size : 0;
+    return req;
 }
 
 std::vector<char> S3::put(
@@ -708,6 +715,199 @@ std::vector<char> S3::put(
     return res.data();
 }
 
+// https://docs.aws.amazon.com/AmazonS3/latest/userguide/mpuoverview.html
+class S3::MultipartUpload : public Upload
+{
+public:
+    MultipartUpload(const S3& s3, const std::string path)
+        : m_s3(s3)
+        , m_path(path)
+        , m_resource(s3.m_config->baseUrl(), path)
+    { }
+
+    // An upload which was started but never completed keeps its parts, and
+    // is billed for them, until it is aborted.
+    ~MultipartUpload()
+    {
+        if (m_id.empty() || m_done) return;
+
+        try
+        {
+            Query query;
+            query["uploadId"] = m_id;
+            send("DELETE", empty, partHeaders(), query);
+        }
+        catch (...) { }
+    }
+
+    void write(const std::vector<char>& data) override
+    {
+        if (m_id.empty()) start();
+
+        if (m_etags.size() == maxParts)
+        {
+            throw ArbiterError(
+                    "Couldn't S3 upload to " + m_path + ": too many parts");
+        }
+
+        Query query;
+        query["partNumber"] = std::to_string(m_etags.size() + 1);
+        query["uploadId"] = m_id;
+
+        const Response res(send("PUT", data, partHeaders(), query));
+        const auto etag(res.header("ETag"));
+        if (!etag) throw ArbiterError(badResponse);
+        m_etags.emplace_back(*etag);
+    }
+
+    void finish(const std::vector<char>& data) override
+    {
+        // A file of a single part doesn't need a multipart upload.
+        if (m_id.empty())
+        {
+            m_s3.put(m_path, data, Headers(), Query());
+            return;
+        }
+
+        if (data.size()) write(data);
+
+        std::string xml("<CompleteMultipartUpload>");
+        for (std::size_t i(0); i < m_etags.size(); ++i)
+        {
+            xml +=
+                "<Part><PartNumber>" + std::to_string(i + 1) +
+                "</PartNumber><ETag>" + m_etags[i] + "</ETag></Part>";
+        }
+        xml += "</CompleteMultipartUpload>";
+
+        Query query;
+        query["uploadId"] = m_id;
+
+        // The completion may still fail after its response has begun, in
+        // which case the error is in the body.
+        const std::string body(
+                send(
+                    "POST",
+                    std::vector<char>(xml.begin(), xml.end()),
+                    partHeaders(),
+                    query).str());
+        if (body.find("<Error>") != std::string::npos)
+        {
+            throw ArbiterError("Couldn't S3 upload to " + m_path + ": " + body);
+        }
+
+        m_done = true;
+    }
+
+private:
+    static constexpr std::size_t maxParts = 10000;
+
+    void start()
+    {
+        Headers headers(m_s3.m_config->baseHeaders());
+        if (getExtension(m_path) == "json")
+        {
+            headers["Content-Type"] = "application/json";
+        }
+
+        Query query;
+        query["uploads"] = "";
+
+        std::vector<char> data(send("POST", empty, headers, query).data());
+        data.push_back('\0');
+
+        Xml::xml_document<> xml;
+        try
+        {
+            xml.parse<0>(data.data());
+        }
+        catch (Xml::parse_error&)
+        {
+            throw ArbiterError("Could not parse S3 response.");
+        }
+
+        if (XmlNode* topNode = xml.first_node("InitiateMultipartUploadResult"))
+        {
+            if (XmlNode* idNode = topNode->first_node("UploadId"))
+            {
+                m_id = idNode->value();
+            }
+        }
+
+        if (m_id.empty()) throw ArbiterError(badResponse);
+    }
+
+    // Encryption settings belong to the creation of the upload only.
+    Headers partHeaders() const
+    {
+        Headers headers(m_s3.m_config->baseHeaders());
+        headers.erase("x-amz-server-side-encryption");
+        return headers;
+    }
+
+    Response send(
+            const std::string verb,
+            const std::vector<char>& data,
+            const Headers& headers,
+            const Query& query) const
+    {
+        const ApiV4 apiV4(
+                verb,
+                m_s3.m_config->region(),
+                m_resource,
+                m_s3.authFields(),
+                query,
+                headers,
+                data);
+
+        drivers::Http http(m_s3.m_pool);
+        Response res(verb == "PUT" ?
+                http.internalPut(
+                    m_resource.url(),
+                    data,
+                    apiV4.headers(),
+                    apiV4.query()) :
+            verb == "DELETE" ?
+                http.internalDelete(
+                    m_resource.url(),
+                    apiV4.headers(),
+                    apiV4.query()) :
+                http.internalPost(
+                    m_resource.url(),
+                    data,
+                    apiV4.headers(),
+                    apiV4.query()));
+
+        if (!res.ok())
+        {
+            throw ArbiterError(
+                    "Couldn't S3 upload to " + m_path + ": " + res.str());
+        }
+
+        return res;
+    }
+
+    const S3& m_s3;
+    const std::string m_path;
+    const Resource m_resource;
+
+    std::string m_id;
+    std::vector<std::string> m_etags;
+    bool m_done = false;
+};
+
+std::unique_ptr<Upload> S3::upload(
+        const std::string path,
+        const std::size_t partSize) const
+{
+    if (partSize < 5 * 1024 * 1024)
+    {
+        throw ArbiterError("S3 upload parts must be at least 5 MiB");
+    }
+
+    return std::unique_ptr<Upload>(new MultipartUpload(*this, path));
+}
+
 void S3::copy(const std::string src, const std::string dst) const
 {
     Headers headers;
@@ -998,6 +1198,15 @@ S3::Resource::Resource(std::string base, std::string fullPath)
     , m_object()
     , m_virtualHosted()
 {
+    // The endpoint may name its scheme, as AWS_ENDPOINT_URL does, for a
+    // server without TLS.
+    const std::size_t scheme(m_baseUrl.find("://"));
+    if (scheme != std::string::npos)
+    {
+        m_scheme = m_baseUrl.substr(0, scheme);
+        m_baseUrl = m_baseUrl.substr(scheme + 3);
+    }
+
     fullPath = sanitize(fullPath);
     const std::size_t split(fullPath.find("/"));
 
@@ -1058,11 +1267,11 @@ std::string S3::Resource::url() const
 {
     if (m_virtualHosted)
     {
-        return "https://" + m_bucket + "." + m_baseUrl + m_object;
+        return m_scheme + "://" + m_bucket + "." + m_baseUrl + m_object;
     }
     else
     {
-        return "https://" + m_baseUrl + m_bucket + "/" + m_object;
+        return m_scheme + "://" + m_baseUrl + m_bucket + "/" + m_object;
     }
 }
 
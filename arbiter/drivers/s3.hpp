@@ -79,13 +79,27 @@ private:
             http::Headers headers,
             http::Query query) const override;
 
+    /** Inherited from Drivers::Http. */
+    virtual http::Request getRequest(
+            std::string path,
+            http::Headers headers,
+            http::Query query) const override;
+
     virtual std::vector<std::string> glob(
             std::string path,
             bool verbose) const override;
 
+    /** Uploads with the multipart upload API, or a single PUT for files of
+     * one part.  Parts must be at least 5 MiB.
+     */
+    virtual std::unique_ptr<Upload> upload(
+            std::string path,
+            std::size_t partSize) const override;
+
     AuthFields authFields() const;
 
     class ApiV4;
+    class MultipartUpload;
     class Resource;
 
     std::unique_ptr<Auth> m_auth;
@@ -114,22 +128,34 @@ private:
 class S3::Auth
 {
 public:
-    Auth(std::string access, std::string hidden, std::string token = "")
-        : m_access(access)
+    Auth(
+            http::Pool& pool,
+            std::string access,
+            std::string hidden,
+            std::string token = "")
+        : m_pool(pool)
+        , m_access(access)
         , m_hidden(hidden)
         , m_token(token)
     { }
 
-    Auth(std::string credUrl, ReauthMethod reauthMethod)
-        : m_credUrl(internal::makeUnique<std::string>(credUrl))
+    Auth(http::Pool& pool, std::string credUrl, ReauthMethod reauthMethod)
+        : m_pool(pool)
+        , m_credUrl(internal::makeUnique<std::string>(credUrl))
         , m_reauthMethod(reauthMethod)
     { }
 
-    static std::unique_ptr<Auth> create(std::string profile, std::string s);
+    // Credential requests go through @p pool, which must outlive the Auth.
+    static std::unique_ptr<Auth> create(
+            http::Pool& pool,
+            std::string s,
+            std::string profile);
 
     AuthFields fields() const;
 
 private:
+    http::Pool& m_pool;
+
     mutable std::string m_access;
     mutable std::string m_hidden;
     mutable std::string m_token;
@@ -177,6 +203,7 @@ public:
     std::string canonicalUri() const;
 
 private:
+    std::string m_scheme = "https";
     std::string m_baseUrl;
     std::string m_bucket;
     std::string m_object;
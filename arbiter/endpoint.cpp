@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <fstream>
+#include <future>
+#include <thread>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/endpoint.hpp>
@@ -7,6 +9,7 @@
 #include <arbiter/arbiter.hpp>
 #include <arbiter/driver.hpp>
 #include <arbiter/drivers/fs.hpp>
+#include <arbiter/stream.hpp>
 #include <arbiter/util/sha256.hpp>
 #include <arbiter/util/transforms.hpp>
 #include <arbiter/util/util.hpp>
@@ -35,9 +38,13 @@ namespace
     }
 }
 
-Endpoint::Endpoint(const Driver& driver, const std::string root)
+Endpoint::Endpoint(
+        const Driver& driver,
+        const std::string root,
+        const std::size_t concurrency)
     : m_driver(&driver)
     , m_root(expandTilde(postfixSlash(root)))
+    , m_concurrency(concurrency)
 { }
 
 std::string Endpoint::root() const
@@ -163,6 +170,45 @@ std::unique_ptr<std::vector<char>> Endpoint::tryGetBinary(
     return m_driver->tryGetBinary(fullPath(subpath));
 }
 
+std::vector<char> Endpoint::getRange(
+        const std::string subpath,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_driver->getRange(fullPath(subpath), offset, length);
+}
+
+std::unique_ptr<std::vector<char>> Endpoint::tryGetRange(
+        const std::string subpath,
+        const std::size_t offset,
+        const std::size_t length) const
+{
+    return m_driver->tryGetRange(fullPath(subpath), offset, length);
+}
+
+std::vector<std::vector<char>> Endpoint::getRanges(
+        const std::string subpath,
+        const std::vector<ByteRange>& ranges,
+        const std::size_t gap) const
+{
+    return m_driver->getRanges(fullPath(subpath), ranges, gap);
+}
+
+std::unique_ptr<ReadStream> Endpoint::openRead(
+        const std::string subpath,
+        const std::size_t chunkSize,
+        const std::size_t depth) const
+{
+    return m_driver->openRead(fullPath(subpath), chunkSize, depth);
+}
+
+std::unique_ptr<WriteStream> Endpoint::openWrite(
+        const std::string subpath,
+        const std::size_t partSize) const
+{
+    return m_driver->openWrite(fullPath(subpath), partSize);
+}
+
 std::size_t Endpoint::getSize(const std::string subpath) const
 {
     return m_driver->getSize(fullPath(subpath));
@@ -190,6 +236,66 @@ std::unique_ptr<std::size_t> Endpoint::tryGetSize(
     return getHttpDriver().tryGetSize(fullPath(subpath), headers, query);
 }
 
+std::vector<BatchResult> Endpoint::getMany(
+        const std::vector<std::string>& subpaths,
+        const std::size_t concurrency) const
+{
+    std::vector<BatchResult> results(subpaths.size());
+    internal::windowed(subpaths.size(), batchSize(concurrency), [&](
+                std::size_t i)
+    {
+        return m_driver->fetch(fullPath(subpaths[i]));
+    },
+    [&](std::size_t i, std::future<std::vector<char>>& data)
+    {
+        try
+        {
+            results[i].data = data.get();
+        }
+        catch (std::exception& e)
+        {
+            results[i].error = e.what();
+        }
+        catch (...)
+        {
+            results[i].error = "Unknown error";
+        }
+    });
+    return results;
+}
+
+std::vector<BatchResult> Endpoint::putMany(
+        const std::vector<std::pair<std::string, std::vector<char>>>& items,
+        const std::size_t concurrency) const
+{
+    std::vector<BatchResult> results(items.size());
+    internal::parallelFor(items.size(), batchSize(concurrency), [&](
+                std::size_t i)
+    {
+        try
+        {
+            put(items[i].first, items[i].second);
+        }
+        catch (std::exception& e)
+        {
+            results[i].error = e.what();
+        }
+        catch (...)
+        {
+            results[i].error = "Unknown error";
+        }
+    });
+    return results;
+}
+
+std::size_t Endpoint::batchSize(const std::size_t concurrency) const
+{
+    if (concurrency) return concurrency;
+    return isRemote() ?
+        m_concurrency :
+        (std::max)(1u, std::thread::hardware_concurrency());
+}
+
 void Endpoint::put(const std::string subpath, const std::string& data) const
 {
     m_driver->put(fullPath(subpath), data);
@@ -299,7 +405,7 @@ std::string Endpoint::prefixedFullPath(const std::string& subpath) const
 
 Endpoint Endpoint::getSubEndpoint(std::string subpath) const
 {
-    return Endpoint(*m_driver, m_root + subpath);
+    return Endpoint(*m_driver, m_root + subpath, m_concurrency);
 }
 
 std::string Endpoint::softPrefix() const
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <functional>
 #include <string>
+#include <utility>
 #include <vector>
 #include <memory>
 
@@ -24,6 +26,8 @@ namespace drivers { class Http; }
 namespace http { class Pool; }
 
 class Driver;
+class ReadStream;
+class WriteStream;
 
 /** @brief A utility class to drive usage from a common root directory.
  *
@@ -40,7 +44,7 @@ class ARBITER_DLL Endpoint
     friend class Arbiter;
 
 public:
-    Endpoint() : m_driver(nullptr)
+    Endpoint() : m_driver(nullptr), m_concurrency(0)
     {}
 
     /** Returns root directory name without any type-prefixing, and will
@@ -91,6 +95,35 @@ public:
     /** Passthrough to Driver::tryGetBinary. */
     std::unique_ptr<std::vector<char>> tryGetBinary(std::string subpath) const;
 
+    /** Passthrough to Driver::getRange. */
+    std::vector<char> getRange(
+            std::string subpath,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Passthrough to Driver::tryGetRange. */
+    std::unique_ptr<std::vector<char>> tryGetRange(
+            std::string subpath,
+            std::size_t offset,
+            std::size_t length) const;
+
+    /** Passthrough to Driver::getRanges. */
+    std::vector<std::vector<char>> getRanges(
+            std::string subpath,
+            const std::vector<ByteRange>& ranges,
+            std::size_t gap = 64 * 1024) const;
+
+    /** Passthrough to Driver::openRead. */
+    std::unique_ptr<ReadStream> openRead(
+            std::string subpath,
+            std::size_t chunkSize = 1024 * 1024,
+            std::size_t depth = 4) const;
+
+    /** Passthrough to Driver::openWrite. */
+    std::unique_ptr<WriteStream> openWrite(
+            std::string subpath,
+            std::size_t partSize = 8 * 1024 * 1024) const;
+
     /** Passthrough to Driver::getSize. */
     std::size_t getSize(std::string subpath) const;
 
@@ -105,6 +138,16 @@ public:
      */
     void put(std::string subpath, const std::vector<char>& data) const;
 
+    /** Get many files at once, see Arbiter::getMany. */
+    std::vector<BatchResult> getMany(
+            const std::vector<std::string>& subpaths,
+            std::size_t concurrency = 0) const;
+
+    /** Write many files at once, see Arbiter::putMany. */
+    std::vector<BatchResult> putMany(
+            const std::vector<std::pair<std::string, std::vector<char>>>& items,
+            std::size_t concurrency = 0) const;
+
     // HTTP-specific passthroughs.
 
     /** Passthrough to
@@ -210,7 +253,9 @@ public:
             http::Query query = http::Query()) const;
 
 private:
-    Endpoint(const Driver& driver, std::string root);
+    // Batches of remote paths run up to @p concurrency at once by default,
+    // see Arbiter::getMany.
+    Endpoint(const Driver& driver, std::string root, std::size_t concurrency);
 
     // If `isRemote()`, returns the type and delimiter, otherwise returns an
     // empty string.
@@ -219,8 +264,13 @@ private:
     const drivers::Http* tryGetHttpDriver() const;
     const drivers::Http& getHttpDriver() const;
 
+    // How many items of a batch to run at once, given the @p concurrency
+    // requested, see Arbiter::getMany.
+    std::size_t batchSize(std::size_t concurrency) const;
+
     const Driver* m_driver;
     std::string m_root;
+    std::size_t m_concurrency;
 };
 
 } // namespace arbiter
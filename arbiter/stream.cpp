@@ -0,0 +1,382 @@
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/stream.hpp>
+
+#include <arbiter/arbiter.hpp>
+#include <arbiter/driver.hpp>
+#include <arbiter/util/http.hpp>
+#include <arbiter/util/types.hpp>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <future>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class ReadStream::Buffer : public std::streambuf
+{
+public:
+    Buffer(
+            const Driver& driver,
+            std::string path,
+            const std::size_t chunkSize,
+            const std::size_t depth)
+        : m_driver(driver)
+        , m_path(path)
+        , m_size(driver.getSize(path))
+        , m_chunkSize(chunkSize)
+        , m_depth(depth)
+        , m_priority(http::PriorityScope::current())
+        , m_cancel(http::CancellationScope::current())
+    {
+        if (!m_chunkSize) throw ArbiterError("Chunk size must be positive");
+    }
+
+    ~Buffer()
+    {
+        while (m_ahead.size())
+        {
+            drop(std::move(m_ahead.front()));
+            m_ahead.pop_front();
+        }
+
+        // Those never started are left undone.
+        for (auto& f : m_dropped)
+        {
+            if (f.wait_for(std::chrono::seconds(0)) !=
+                    std::future_status::deferred)
+            {
+                f.wait();
+            }
+        }
+    }
+
+    std::size_t size() const { return m_size; }
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+        const std::size_t next(m_offset + m_chunk.size());
+        if (next >= m_size) return traits_type::eof();
+
+        load(next);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    pos_type seekoff(
+            off_type off,
+            std::ios_base::seekdir dir,
+            std::ios_base::openmode which) override
+    {
+        off_type base(0);
+        if (dir == std::ios_base::cur) base = position();
+        else if (dir == std::ios_base::end) base = m_size;
+        return seekpos(base + off, which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        const pos_type fail(off_type(-1));
+        if (!(which & std::ios_base::in)) return fail;
+        if (pos < 0 || static_cast<std::size_t>(pos) > m_size) return fail;
+
+        const std::size_t p(pos);
+        if (p >= m_offset && p < m_offset + m_chunk.size())
+        {
+            setg(eback(), eback() + (p - m_offset), egptr());
+        }
+        else if (p == m_size)
+        {
+            m_chunk.clear();
+            m_offset = m_size;
+            setg(nullptr, nullptr, nullptr);
+        }
+        else load(p);
+
+        return pos;
+    }
+
+private:
+    off_type position() const
+    {
+        return m_offset + (gptr() - eback());
+    }
+
+    // Make the chunk containing @p pos current, positioned at @p pos, and
+    // top up the chunks being read ahead of it.
+    void load(const std::size_t pos)
+    {
+        const std::size_t index(pos / m_chunkSize);
+
+        // Chunks behind the new one are no longer wanted, and after a long
+        // seek none of those ahead are either.
+        while (m_ahead.size() && m_ahead.front().index != index)
+        {
+            drop(std::move(m_ahead.front()));
+            m_ahead.pop_front();
+        }
+        if (m_ahead.empty()) m_ahead.push_back(fetch(index));
+
+        const std::size_t chunks((m_size + m_chunkSize - 1) / m_chunkSize);
+        std::size_t next(m_ahead.back().index + 1);
+        while (next <= index + m_depth && next < chunks)
+        {
+            m_ahead.push_back(fetch(next));
+            ++next;
+        }
+
+        Chunk current(std::move(m_ahead.front()));
+        m_ahead.pop_front();
+
+        // On failure, leave an empty buffer at the new position so that
+        // another read retries it.
+        m_offset = pos;
+        m_chunk.clear();
+        setg(nullptr, nullptr, nullptr);
+
+        unlisten(current);
+        m_chunk = std::move(current.data.get().front());
+        m_offset = index * m_chunkSize;
+        if (pos - m_offset >= m_chunk.size())
+        {
+            throw ArbiterError("Unexpected end of file " + m_path);
+        }
+
+        char* data(m_chunk.data());
+        setg(data, data + (pos - m_offset), data + m_chunk.size());
+    }
+
+    // A chunk being read, which may be cancelled on its own, and is also
+    // cancelled along with the stream.
+    struct Chunk
+    {
+        std::size_t index = 0;
+        http::Cancellation cancel;
+        std::size_t listener = 0;
+        std::future<std::vector<std::vector<char>>> data;
+    };
+
+    Chunk fetch(const std::size_t index) const
+    {
+        Chunk chunk;
+        chunk.index = index;
+        chunk.cancel = http::Cancellation::at(m_cancel.deadline());
+        const http::Cancellation cancel(chunk.cancel);
+        if (m_cancel)
+        {
+            chunk.listener = m_cancel.listen([cancel]() { cancel.cancel(); });
+            if (m_cancel.cancelled()) cancel.cancel();
+        }
+
+        const std::size_t offset(index * m_chunkSize);
+        ByteRange range;
+        range.offset = offset;
+        range.length = (std::min)(m_chunkSize, m_size - offset);
+
+        const http::PriorityScope priorityScope(m_priority);
+        const http::CancellationScope cancelScope(cancel);
+        chunk.data = m_driver.fetch(m_path, { range });
+        return chunk;
+    }
+
+    // Give up on a chunk without waiting for it, keeping it only until it
+    // is done since its read may refer to the Driver.
+    void drop(Chunk chunk)
+    {
+        unlisten(chunk);
+        chunk.cancel.cancel();
+        m_dropped.push_back(std::move(chunk.data));
+
+        const auto done([](const std::future<std::vector<std::vector<char>>>& f)
+        {
+            return f.wait_for(std::chrono::seconds(0)) !=
+                std::future_status::timeout;
+        });
+        m_dropped.erase(
+                std::remove_if(m_dropped.begin(), m_dropped.end(), done),
+                m_dropped.end());
+    }
+
+    void unlisten(const Chunk& chunk) const
+    {
+        if (m_cancel) m_cancel.unlisten(chunk.listener);
+    }
+
+    const Driver& m_driver;
+    const std::string m_path;
+    const std::size_t m_size;
+    const std::size_t m_chunkSize;
+    const std::size_t m_depth;
+    const http::Priority m_priority;
+    const http::Cancellation m_cancel;
+
+    // The current chunk, which starts at byte m_offset of the file.
+    std::vector<char> m_chunk;
+    std::size_t m_offset = 0;
+
+    // Chunks being read ahead, by consecutive index, and those given up on
+    // which may still be running.
+    std::deque<Chunk> m_ahead;
+    std::vector<std::future<std::vector<std::vector<char>>>> m_dropped;
+};
+
+ReadStream::ReadStream(
+        const Driver& driver,
+        const std::string path,
+        const std::size_t chunkSize,
+        const std::size_t depth)
+    : std::istream(nullptr)
+    , m_buffer(new Buffer(driver, path, chunkSize, depth))
+{
+    rdbuf(m_buffer.get());
+}
+
+// Cancels the chunks still being read ahead, and waits for them to stop.
+ReadStream::~ReadStream() { }
+
+std::size_t ReadStream::size() const
+{
+    return m_buffer->size();
+}
+
+class WriteStream::Buffer : public std::streambuf
+{
+public:
+    Buffer(std::unique_ptr<Upload> upload, const std::size_t partSize)
+        : m_upload(std::move(upload))
+        , m_part(partSize)
+        , m_priority(http::PriorityScope::current())
+        , m_cancel(http::CancellationScope::current())
+    {
+        if (!partSize) throw ArbiterError("Part size must be positive");
+        setp(m_part.data(), m_part.data() + m_part.size());
+    }
+
+    void close()
+    {
+        if (m_error) std::rethrow_exception(m_error);
+        if (m_closed) return;
+
+        try
+        {
+            wait();
+            m_part.resize(pptr() - pbase());
+            setp(nullptr, nullptr);
+            m_upload->finish(m_part);
+            m_closed = true;
+        }
+        catch (...)
+        {
+            m_error = std::current_exception();
+            throw;
+        }
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (m_error || m_closed) return traits_type::eof();
+
+        try
+        {
+            send();
+        }
+        catch (...)
+        {
+            // A lost part can't be made up, so no more may be written.  The
+            // stream only sees badbit, so keep the error for close.
+            m_error = std::current_exception();
+            setp(nullptr, nullptr);
+            throw;
+        }
+
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+private:
+    // Upload the full part in the background and start filling the buffer
+    // of the previous one, once it's done.
+    void send()
+    {
+        wait();
+        std::swap(m_part, m_sending);
+        m_part.resize(m_sending.size());
+        setp(m_part.data(), m_part.data() + m_part.size());
+
+        m_sent = std::async(std::launch::async, [this]()
+        {
+            const http::PriorityScope priorityScope(m_priority);
+            const http::CancellationScope cancelScope(m_cancel);
+            m_upload->write(m_sending);
+        });
+    }
+
+    // Rethrows a failure of the part in flight.
+    void wait()
+    {
+        if (m_sent.valid()) m_sent.get();
+    }
+
+    std::unique_ptr<Upload> m_upload;
+    std::vector<char> m_part;
+    std::vector<char> m_sending;
+    bool m_closed = false;
+    std::exception_ptr m_error;
+
+    const http::Priority m_priority;
+    const http::Cancellation m_cancel;
+
+    // The upload of m_sending, if any.  Declared last so that destruction
+    // waits for it before anything it uses goes away.
+    std::future<void> m_sent;
+};
+
+WriteStream::WriteStream(
+        std::unique_ptr<Upload> upload,
+        const std::size_t partSize)
+    : std::ostream(nullptr)
+    , m_buffer(new Buffer(std::move(upload), partSize))
+{
+    rdbuf(m_buffer.get());
+}
+
+// Waits for the part in flight, but abandons the upload if not closed.
+WriteStream::~WriteStream() { }
+
+void WriteStream::close()
+{
+    try
+    {
+        m_buffer->close();
+    }
+    catch (...)
+    {
+        setstate(std::ios_base::badbit);
+        throw;
+    }
+}
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef ARBITER_IS_AMALGAMATION
+#include <arbiter/util/exports.hpp>
+#endif
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+namespace ARBITER_CUSTOM_NAMESPACE
+{
+#endif
+
+namespace arbiter
+{
+
+class Driver;
+
+/** @brief A seekable std::istream over a possibly remote file.
+ *
+ * The file is read in ranged chunks, see Driver::getRange, and up to a fixed
+ * depth of the chunks following the one being read are fetched ahead of
+ * time, concurrently and with the priority and http::Cancellation of the
+ * thread that opened the stream.  A sequential reader therefore overlaps
+ * its own processing with I/O while holding at most `depth + 1` chunks.
+ * Reads of the chunks left behind by a seek are cancelled rather than
+ * waited for.
+ *
+ * Read failures set `badbit`, or throw if enabled with `exceptions()`.
+ *
+ * Created by Driver::openRead, and must not outlive its Driver.
+ */
+class ARBITER_DLL ReadStream : public std::istream
+{
+public:
+    /** Throws ArbiterError if the size of the file can't be found. */
+    ReadStream(
+            const Driver& driver,
+            std::string path,
+            std::size_t chunkSize,
+            std::size_t depth);
+    ~ReadStream();
+
+    ReadStream(const ReadStream&) = delete;
+    ReadStream& operator=(const ReadStream&) = delete;
+
+    /** The size of the file in bytes, as of opening it. */
+    std::size_t size() const;
+
+private:
+    class Buffer;
+    std::unique_ptr<Buffer> m_buffer;
+};
+
+/** @brief An upload of a file in parts, created by Driver::upload for a
+ * WriteStream.
+ *
+ * Parts are handed over in order and one at a time, though not necessarily
+ * from the same thread.  The file should not appear at its path until
+ * Upload::finish, and destroying an unfinished Upload abandons it.
+ */
+class ARBITER_DLL Upload
+{
+public:
+    virtual ~Upload() { }
+
+    /** Upload the next part of the file, exactly the part size that the
+     * WriteStream was opened with.
+     */
+    virtual void write(const std::vector<char>& data) = 0;
+
+    /** Upload the rest of the file, which may be empty and is at most the
+     * part size, and complete it.
+     */
+    virtual void finish(const std::vector<char>& data) = 0;
+};
+
+/** @brief A std::ostream which uploads a possibly remote file as it is
+ * written.
+ *
+ * Written data is gathered into parts of a fixed size, each of which is
+ * uploaded in the background while the next is filled, so at most two parts
+ * are held at once.  Data only leaves in whole parts, so flushing the stream
+ * has no effect, and the file is completed by WriteStream::close.  Uploads
+ * run with the priority and http::Cancellation of the thread that opened
+ * the stream.
+ *
+ * Write failures set `badbit`, or throw if enabled with `exceptions()`.
+ * Destroying a stream without closing it abandons the upload and leaves
+ * the file as it was.
+ *
+ * Created by Driver::openWrite, and must not outlive its Driver.
+ */
+class ARBITER_DLL WriteStream : public std::ostream
+{
+public:
+    WriteStream(std::unique_ptr<Upload> upload, std::size_t partSize);
+    ~WriteStream();
+
+    WriteStream(const WriteStream&) = delete;
+    WriteStream& operator=(const WriteStream&) = delete;
+
+    /** Upload the remaining data and complete the file.  Throws the error
+     * that failed the upload, if any part of it failed.  Does nothing if
+     * already closed.
+     */
+    void close();
+
+private:
+    class Buffer;
+    std::unique_ptr<Buffer> m_buffer;
+};
+
+} // namespace arbiter
+
+#ifdef ARBITER_CUSTOM_NAMESPACE
+}
+#endif
+
@@ -2,6 +2,7 @@
 #include <cstring>
 #include <ios>
 #include <iostream>
+#include <mutex>
 
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/curl.hpp>
@@ -25,6 +26,57 @@ using namespace internal;
 namespace http
 {
 
+namespace
+{
+    // DNS lookups and TLS sessions cached across every Curl in the process,
+    // so that handles in different pools, shards, or freshly opened ones skip
+    // repeated lookups and full handshakes.  Connections themselves are
+    // shared among all the handles of a multi handle already, and libcurl
+    // does not support sharing them between concurrently running threads.
+    class Share
+    {
+    public:
+        static CURLSH* get()
+        {
+            // Never destroyed, since handles may outlive static destruction.
+            static Share* share(new Share());
+            return share->m_share;
+        }
+
+    private:
+        Share()
+        {
+            curl_global_init(CURL_GLOBAL_ALL);
+            m_share = curl_share_init();
+            curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &Share::lock);
+            curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &Share::unlock);
+            curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+            curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(
+                m_share,
+                CURLSHOPT_SHARE,
+                CURL_LOCK_DATA_SSL_SESSION);
+        }
+
+        static void lock(
+                CURL*,
+                curl_lock_data data,
+                curl_lock_access,
+                void* self)
+        {
+            static_cast<Share*>(self)->m_mutexes[data].lock();
+        }
+
+        static void unlock(CURL*, curl_lock_data data, void* self)
+        {
+            static_cast<Share*>(self)->m_mutexes[data].unlock();
+        }
+
+        CURLSH* m_share = nullptr;
+        std::mutex m_mutexes[CURL_LOCK_DATA_LAST];
+    };
+} // unnamed namespace
+
 Curl::Curl(std::size_t id, const std::string& s) : m_id(id)
 {
     const json c(s.size() ? json::parse(s) : json::object());
@@ -39,6 +91,9 @@ Curl::Curl(std::size_t id, const std::string& s) : m_id(id)
     //      - caInfo            (CURLOPT_CAINFO)
     //      - verifyPeer        (CURLOPT_SSL_VERIFYPEER)
     //      - proxy             (CURLOPT_PROXY)
+    //      - http2             (CURLOPT_HTTP_VERSION)
+    //      - h2c               (CURLOPT_HTTP_VERSION)
+    //      - resolve           (CURLOPT_RESOLVE)
 
     using Keys = std::vector<std::string>;
     auto find([](const Keys& keys)->std::unique_ptr<std::string>
@@ -92,6 +147,21 @@ Curl::Curl(std::size_t id, const std::string& s) : m_id(id)
             {
                 m_verifyPeer = h["verifyPeer"].get<bool>();
             }
+
+            if (h.count("http2"))
+            {
+                m_http2 = h["http2"].get<bool>();
+            }
+
+            if (h.count("h2c"))
+            {
+                m_h2c = h["h2c"].get<bool>();
+            }
+
+            if (h.count("resolve"))
+            {
+                m_resolve = h["resolve"].get<std::vector<std::string>>();
+            }
         }
     }
 
@@ -111,6 +181,8 @@ Curl::Curl(std::size_t id, const std::string& s) : m_id(id)
     Keys caPathKeys{ "CURL_CA_PATH", "ARBITER_CA_PATH" };
     Keys caBundleKeys{ "CURL_CA_BUNDLE", "ARBITER_CA_BUNDLE" };
     Keys caInfoKeys{ "CURL_CAINFO", "CURL_CA_INFO", "ARBITER_CA_INFO" };
+    Keys http2Keys{ "ARBITER_HTTP2" };
+    Keys h2cKeys{ "ARBITER_H2C" };
     Keys ProxyKeys{ "CURL_PROXY", "HTTP_PROXY", "HTTPS_PROXY", "ALL_PROXY", "ARBITER_PROXY"};
 
     if (auto v = find(verboseKeys)) m_verbose = !!std::stol(*v);
@@ -121,6 +193,8 @@ Curl::Curl(std::size_t id, const std::string& s) : m_id(id)
     if (auto v = find(caBundleKeys)) m_caBundle = mk(*v);
     if (auto v = find(caInfoKeys)) m_caInfo = mk(*v);
     if (auto v = find(ProxyKeys)) m_proxy = mk(*v);
+    if (auto v = find(http2Keys)) m_http2 = !!std::stol(*v);
+    if (auto v = find(h2cKeys)) m_h2c = !!std::stol(*v);
 
     static bool logged(false);
     if (m_verbose && !logged)
@@ -130,20 +204,34 @@ Curl::Curl(std::size_t id, const std::string& s) : m_id(id)
             "\n\ttimeout: " << m_timeout << "s" <<
             "\n\tfollowRedirect: " << m_followRedirect <<
             "\n\tverifyPeer: " << m_verifyPeer <<
+            "\n\thttp2: " << m_http2 <<
+            "\n\th2c: " << m_h2c <<
             "\n\tcaPath: " << (m_caPath ? *m_caPath : "(default)") <<
             "\n\tcaBundle: " << (m_caBundle ? *m_caBundle : "(default)") <<
             "\n\tcaInfo: " << (m_caInfo ? *m_caInfo : "(default)") <<
             "\n\tProxy: " << (m_proxy ? *m_proxy : "(default)") <<
             std::endl;
     }
+
+    if (m_curl) configure();
 }
 
 Curl::~Curl()
+{
+    close();
+}
+
+void Curl::close()
 {
     if (m_curl)
         curl_easy_cleanup(m_curl);
     if (m_headers)
         curl_slist_free_all(m_headers);
+    if (m_resolveList)
+        curl_slist_free_all(m_resolveList);
+    m_curl = nullptr;
+    m_headers = nullptr;
+    m_resolveList = nullptr;
 }
 
 // The only time this should be invoked is when things are moving in a vector of Curls.
@@ -152,38 +240,41 @@ Curl::Curl(Curl&& other)
     m_curl = other.m_curl; other.m_curl = nullptr;
     m_headers = other.m_headers; other.m_headers = nullptr;
     m_id = other.m_id;
+    m_shard = other.m_shard;
     m_code = other.m_code;
     m_state = other.m_state; other.m_state = State::UNUSED;
     m_verbose = other.m_verbose;
     m_timeout = other.m_timeout;
     m_followRedirect = other.m_followRedirect;
     m_verifyPeer = other.m_verifyPeer;
+    m_http2 = other.m_http2;
+    m_h2c = other.m_h2c;
     m_caPath = std::move(other.m_caPath);
     m_caInfo = std::move(other.m_caInfo);
+    m_caBundle = std::move(other.m_caBundle);
     m_proxy = std::move(other.m_proxy);
+    m_resolve = std::move(other.m_resolve);
+    m_resolveList = other.m_resolveList; other.m_resolveList = nullptr;
     m_response = std::move(other.m_response);
     m_putData = std::move(other.m_putData);
+    m_sentHeaders = std::move(other.m_sentHeaders);
+    m_lowSpeedTime = other.m_lowSpeedTime;
+
+    // Our easy handle still refers to the members of the moved-from Curl.
+    if (m_curl) configure();
 }
 
-void Curl::init(
-        const std::string& rawPath,
-        const Headers& headers,
-        const Query& query)
+void Curl::configure()
 {
-    // Reset our curl instance and header list.
-    curl_easy_reset(m_curl);
-    curl_slist_free_all(m_headers);
-    m_headers = nullptr;
+    // Allow the Pool to get back to us from the bare CURL handle.
+    curl_easy_setopt(m_curl, CURLOPT_PRIVATE, this);
 
-    // Set path.
-    const std::string path(rawPath + buildQueryString(query));
-    curl_easy_setopt(m_curl, CURLOPT_URL, path.c_str());
+    curl_easy_setopt(m_curl, CURLOPT_SHARE, Share::get());
 
-    curl_version_info_data* versioninfo = curl_version_info(CURLVERSION_NOW);
-    if (!(versioninfo->features & CURL_VERSION_ASYNCHDNS))
-    {
-        curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1L);
-    }
+    static const bool asyncDns(
+            curl_version_info(CURLVERSION_NOW)->features &
+            CURL_VERSION_ASYNCHDNS);
+    if (!asyncDns) curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1L);
 
     // Substantially faster DNS lookups without IPv6.
     curl_easy_setopt(m_curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
@@ -200,6 +291,7 @@ void Curl::init(
     // option to make the timeout a sliding window instead of an absolute.
     curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
     curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, m_timeout);
+    m_lowSpeedTime = m_timeout;
 
     curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT_MS, 1000L);
     curl_easy_setopt(m_curl, CURLOPT_ACCEPTTIMEOUT_MS, 1000L);
@@ -215,37 +307,113 @@ void Curl::init(
     if (m_caInfo) curl_easy_setopt(m_curl, CURLOPT_CAINFO, m_caInfo->c_str());
     if (m_proxy) curl_easy_setopt(m_curl, CURLOPT_PROXY, m_proxy->c_str());
 
-    // Insert supplied headers.
-    for (const auto& h : headers)
+    // Entries of the form "host:port:address", which are added to the shared
+    // DNS cache when a transfer starts, and so reach every handle.
+    if (m_resolve.size())
     {
-        m_headers = curl_slist_append(
-                m_headers,
-                (h.first + ": " + h.second).c_str());
+        if (!m_resolveList)
+        {
+            for (const auto& r : m_resolve)
+            {
+                m_resolveList = curl_slist_append(m_resolveList, r.c_str());
+            }
+        }
+        curl_easy_setopt(m_curl, CURLOPT_RESOLVE, m_resolveList);
+    }
+
+    if (m_http2 || m_h2c)
+    {
+        // Negotiate HTTP/2 over TLS, falling back to HTTP/1.1 if the server
+        // does not offer it.  Plain-text requests stay on HTTP/1.1, unless
+        // the server is known to speak HTTP/2 without being asked (h2c).
+        // Rather than opening a new connection, wait to find out whether a
+        // pending one to the same host can multiplex this request.  Without
+        // HTTP/2 support in libcurl these fail harmlessly.
+        //
+        // Before version 8, libcurl fails all but the first request on an
+        // h2c connection, so there plain text stays on HTTP/1.1 regardless.
+        static const bool h2cWorks(
+                curl_version_info(CURLVERSION_NOW)->version_num >= 0x080000);
+
+        curl_easy_setopt(
+            m_curl,
+            CURLOPT_HTTP_VERSION,
+            (long)(m_h2c && h2cWorks ?
+                CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE :
+                CURL_HTTP_VERSION_2TLS));
+        curl_easy_setopt(m_curl, CURLOPT_PIPEWAIT, 1L);
     }
+
+    // The request body and response are always read from and written to our
+    // own members, whatever the verb.
+    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, PutData::putCb);
+    curl_easy_setopt(m_curl, CURLOPT_READDATA, &m_putData);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, Response::getCb);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_response);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, Response::headerCb);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_response);
 }
 
-void Curl::prepareGet(
-        std::string path,
-        Headers headers,
-        Query query,
-        const std::size_t reserve,
+void Curl::init(
+        const std::string& rawPath,
+        const Headers& headers,
+        const Query& query,
         const std::size_t timeout)
 {
-    m_response.init(reserve);
+    // Reopen our curl instance if it was closed while idle.  Otherwise the
+    // static configuration is still in place from a previous request, and
+    // only what varies per request is set here.
+    if (!m_curl)
+    {
+        m_curl = curl_easy_init();
+        configure();
+    }
+
+    // Set path.
+    const std::string path(rawPath + buildQueryString(query));
+    curl_easy_setopt(m_curl, CURLOPT_URL, path.c_str());
 
-    init(path, headers, query);
-    if (timeout) curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, timeout);
+    // Back to a plain GET, undoing the verb of any previous request.  The
+    // prepare functions set anything else.
+    curl_easy_setopt(m_curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, nullptr);
 
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, Response::getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_response);
+    const long lowSpeedTime(timeout ? static_cast<long>(timeout) : m_timeout);
+    if (lowSpeedTime != m_lowSpeedTime)
+    {
+        curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, lowSpeedTime);
+        m_lowSpeedTime = lowSpeedTime;
+    }
 
-    // Insert all headers into the request.
+    // Insert supplied headers, keeping the previous list if they are the same.
+    if (!m_headers || headers != m_sentHeaders)
+    {
+        curl_slist_free_all(m_headers);
+        m_headers = nullptr;
+
+        for (const auto& h : headers)
+        {
+            m_headers = curl_slist_append(
+                    m_headers,
+                    (h.first + ": " + h.second).c_str());
+        }
+        m_sentHeaders = headers;
+    }
     curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+}
 
-    // Set up callback and data pointer for received headers.
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, Response::headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_response);
+void Curl::prepareGet(
+        std::string path,
+        Headers headers,
+        Query query,
+        const std::size_t reserve,
+        const std::size_t timeout,
+        Sink sink)
+{
+    if (sink) m_response.init(std::move(sink));
+    else m_response.init(reserve);
+
+    init(path, headers, query, timeout);
 }
 
 void Curl::prepareHead(
@@ -256,52 +424,36 @@ void Curl::prepareHead(
 {
     m_response.init();
 
-    init(path, headers, query);
-    if (timeout)
-        curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, timeout);
+    init(path, headers, query, timeout);
 
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, Response::getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_response);
+    // Specify a HEAD request.
+    curl_easy_setopt(m_curl, CURLOPT_NOBODY, 1L);
+}
 
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+void Curl::prepareDelete(
+    std::string path,
+    Headers headers,
+    Query query,
+    const std::size_t timeout)
+{
+    m_response.init();
 
-    // Set up callback and data pointer for received headers.
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, Response::headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_response);
+    init(path, headers, query, timeout);
 
-    // Specify a HEAD request.
-    curl_easy_setopt(m_curl, CURLOPT_NOBODY, 1L);
+    // A GET in all but its name.
+    curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "DELETE");
 }
 
 void Curl::preparePut(
         std::string path,
-        const std::vector<char>& data,
+        const Body data,
         Headers headers,
         Query query,
         const std::size_t timeout)
 {
     m_response.init();
     m_putData.init(data);
-    init(path, headers, query);
-    if (timeout) curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, timeout);
-
-
-    // Register callback function and data pointer to create the request.
-    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, PutData::putCb);
-    curl_easy_setopt(m_curl, CURLOPT_READDATA, &m_putData);
-
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, Response::getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_response);
-
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
-
-    // Set up callback and data pointer for received headers.
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, Response::headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_response);
+    init(path, headers, query, timeout);
 
     // Specify that this is a PUT request.
     curl_easy_setopt(m_curl, CURLOPT_PUT, 1L);
@@ -316,42 +468,64 @@ void Curl::preparePut(
 
 void Curl::preparePost(
         std::string path,
-        const std::vector<char>& data,
+        const Body data,
         Headers headers,
         Query query,
         const std::size_t timeout)
 {
     m_response.init();
     m_putData.init(data);
-    init(path, headers, query);
-    if (timeout) curl_easy_setopt(m_curl, CURLOPT_LOW_SPEED_TIME, timeout);
-
-    // Register callback function and data pointer to create the request.
-    curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, PutData::putCb);
-    curl_easy_setopt(m_curl, CURLOPT_READDATA, &m_putData);
-
-    // Register callback function and data pointer to consume the result.
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, Response::getCb);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_response);
-
-    // Insert all headers into the request.
-    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
-
-    // Set up callback and data pointer for received headers.
-    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, Response::headerCb);
-    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_response);
+    init(path, headers, query, timeout);
 
     // Specify that this is a POST request.
     curl_easy_setopt(m_curl, CURLOPT_POST, 1L);
 
-    // Must use this for binary data, otherwise curl will use strlen(), which
-    // will likely be incorrect.
+    // A POST body from the read callback is sized by this option rather than
+    // CURLOPT_INFILESIZE_LARGE, without which it is sent chunked.
     curl_easy_setopt(
             m_curl,
-            CURLOPT_INFILESIZE_LARGE,
+            CURLOPT_POSTFIELDSIZE_LARGE,
             static_cast<curl_off_t>(data.size()));
 }
 
+void Curl::prepare(const Request& req)
+{
+    switch (req.verb)
+    {
+        case Request::Verb::GET:
+            prepareGet(
+                req.path,
+                req.headers,
+                req.query,
+                req.reserve,
+                req.timeout,
+                req.sink);
+            break;
+        case Request::Verb::HEAD:
+            prepareHead(req.path, req.headers, req.query, req.timeout);
+            break;
+        case Request::Verb::PUT:
+            preparePut(
+                req.path,
+                req.data,
+                req.headers,
+                req.query,
+                req.timeout);
+            break;
+        case Request::Verb::POST:
+            preparePost(
+                req.path,
+                req.data,
+                req.headers,
+                req.query,
+                req.timeout);
+            break;
+        case Request::Verb::DEL:
+            prepareDelete(req.path, req.headers, req.query, req.timeout);
+            break;
+    }
+}
+
 } // namepace http
 } // namespace arbiter
 
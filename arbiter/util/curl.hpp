@@ -37,8 +37,7 @@ class ARBITER_DLL Curl
     enum class State
     {
         UNUSED,     // Waiting to be used for a request.
-        ACQUIRED,   // Acquired by a Resource.
-        READY,      // Initialization complete. Ready to be run.
+        ACQUIRED,   // Bound to a submitted transfer.
         RUNNING,    // Running.
         DONE        // Operation completed
     };
@@ -53,7 +52,8 @@ public:
             Headers headers,
             Query query,
             std::size_t reserve,
-            std::size_t timeout = 0);
+            std::size_t timeout = 0,
+            Sink sink = Sink());
 
     void prepareHead(
             std::string path,
@@ -63,18 +63,27 @@ public:
 
     void preparePut(
             std::string path,
-            const std::vector<char>& data,
+            Body data,
             Headers headers,
             Query query,
             std::size_t timeout = 0);
 
     void preparePost(
             std::string path,
-            const std::vector<char>& data,
+            Body data,
             Headers headers,
             Query query,
             std::size_t timeout = 0);
 
+    void prepareDelete(
+            std::string path,
+            Headers headers,
+            Query query,
+            std::size_t timeout = 0);
+
+    // Dispatch to the prepare function matching the verb of @p req.
+    void prepare(const Request& req);
+
     // Note that the response is *moved*.
     Response response()
     {
@@ -85,23 +94,47 @@ public:
     std::size_t id() const
     { return m_id; }
 
+    // Close the easy handle, which is reopened on the next request.
+    void close();
+
 private:
-    void init(const std::string& path, const Headers& headers, const Query& query);
+    // Apply the options which are the same for every request, once for each
+    // easy handle.
+    void configure();
+
+    // Set the options which vary per request, leaving a plain GET.
+    void init(
+            const std::string& path,
+            const Headers& headers,
+            const Query& query,
+            std::size_t timeout);
 
     CURL* m_curl = nullptr;
     curl_slist* m_headers = nullptr;
+    // The headers from which m_headers was built.
+    Headers m_sentHeaders;
+    // The CURLOPT_LOW_SPEED_TIME currently set on the easy handle.
+    long m_lowSpeedTime = 0;
 
     std::size_t m_id;
     State m_state = State::UNUSED;
+    // Index of the Pool shard whose runner performs this handle's transfers.
+    std::size_t m_shard = 0;
     bool m_verbose = false;
     long m_timeout = defaultHttpTimeout;
     bool m_followRedirect = true;
     bool m_verifyPeer = true;
+    bool m_http2 = false;
+    bool m_h2c = false;
     int m_code = 0;
     std::unique_ptr<std::string> m_caPath;
     std::unique_ptr<std::string> m_caBundle;
     std::unique_ptr<std::string> m_caInfo;
     std::unique_ptr<std::string> m_proxy;
+    // Addresses to use for some hosts in place of looking them up, and the
+    // list of them given to curl.
+    std::vector<std::string> m_resolve;
+    curl_slist* m_resolveList = nullptr;
     Response m_response;
     PutData m_putData;
 };
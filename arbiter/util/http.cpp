@@ -1,15 +1,33 @@
 #ifndef ARBITER_IS_AMALGAMATION
 #include <arbiter/util/http.hpp>
 #include <arbiter/util/json.hpp>
+#include <arbiter/util/time.hpp>
+#include <arbiter/util/util.hpp>
 #endif
 
 #include <curl/curl.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#ifndef ARBITER_WINDOWS
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
+#include <random>
 #include <set>
 #include <sstream>
 #include <thread>
@@ -24,6 +42,87 @@ namespace arbiter
 namespace http
 {
 
+namespace
+{
+    const std::chrono::milliseconds retryBase(500);
+    const std::chrono::milliseconds retryCap(60000);
+
+    // The priority of requests from this thread, see PriorityScope.
+    thread_local Priority threadPriority = Priority::Normal;
+
+    // The Cancellation of requests from this thread, see CancellationScope.
+    thread_local Cancellation threadCancellation;
+
+    // Requests which may be safely duplicated to hedge against a slow
+    // response.  Bodies for a Sink can't be delivered twice.
+    bool hedgeable(const Request& req)
+    {
+        return !req.sink && (
+            req.verb == Request::Verb::GET ||
+            req.verb == Request::Verb::HEAD);
+    }
+
+    // Requests which may share a single transfer with identical ones already
+    // in flight.  Bodies for a Sink can't be delivered to more than one, and
+    // cancelling one request mustn't cancel the others.
+    bool coalescable(const Request& req)
+    {
+        return !req.sink && !req.cancel && (
+            req.verb == Request::Verb::GET ||
+            req.verb == Request::Verb::HEAD);
+    }
+
+    // Transport failures which may well succeed if tried again, unlike ones
+    // such as a malformed URL.
+    bool isTransient(const CURLcode code)
+    {
+        switch (code)
+        {
+            case CURLE_COULDNT_RESOLVE_PROXY:
+            case CURLE_COULDNT_RESOLVE_HOST:
+            case CURLE_COULDNT_CONNECT:
+            case CURLE_HTTP2:
+            case CURLE_PARTIAL_FILE:
+            case CURLE_OPERATION_TIMEDOUT:
+            case CURLE_SSL_CONNECT_ERROR:
+            case CURLE_GOT_NOTHING:
+            case CURLE_SEND_ERROR:
+            case CURLE_RECV_ERROR:
+            case CURLE_HTTP2_STREAM:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Transport failures which left the request unsent, since there was no
+    // connection to send it on.
+    bool isUnsent(const CURLcode code)
+    {
+        switch (code)
+        {
+            case CURLE_COULDNT_RESOLVE_PROXY:
+            case CURLE_COULDNT_RESOLVE_HOST:
+            case CURLE_COULDNT_CONNECT:
+            case CURLE_SSL_CONNECT_ERROR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Whether a transport failure of @p req may be retried.  One which may
+    // have reached the server is only sent again if that is harmless, so a
+    // POST which started an upload, say, is not started twice.
+    bool resendable(const Request& req, const CURLcode code)
+    {
+        return isTransient(code) && (
+            isUnsent(code) ||
+            req.verb != Request::Verb::POST ||
+            req.idempotent);
+    }
+} // unnamed namespace
+
 std::string sanitize(const std::string& path, const std::string& excStr)
 {
     auto ispunct = [](char c) -> bool
@@ -72,34 +171,195 @@ std::string buildQueryString(const Query& query)
     return out;
 }
 
+std::chrono::milliseconds retryAfter(const Response& res)
+{
+    using ms = std::chrono::milliseconds;
+
+    try
+    {
+        if (const auto v = res.header("x-ms-retry-after-ms"))
+        {
+            return ms((std::max)(0LL, std::stoll(std::string(*v))));
+        }
+
+        if (const auto v = res.header("Retry-After"))
+        {
+            const std::string val(*v);
+
+            if (val.size() && std::all_of(val.begin(), val.end(), ::isdigit))
+            {
+                return std::chrono::seconds(std::stoll(val));
+            }
+
+            const int64_t s(Time(val, Time::rfc822) - Time());
+            return std::chrono::seconds((std::max)((int64_t)0, s));
+        }
+    }
+    catch (...) { }
+
+    return ms(0);
+}
+
+std::chrono::milliseconds jitter(
+        const std::chrono::milliseconds prev,
+        const std::chrono::milliseconds base,
+        const std::chrono::milliseconds cap,
+        std::mt19937_64& rng)
+{
+    using ms = std::chrono::milliseconds;
+
+    const long long from((std::max)(prev, base).count());
+    std::uniform_int_distribution<long long> dist(base.count(), from * 3);
+    return (std::min)(ms(dist(rng)), cap);
+}
+
+std::string hostOf(const std::string& url)
+{
+    std::size_t begin(url.find("://"));
+    begin = begin == std::string::npos ? 0 : begin + 3;
+
+    std::size_t end(url.find_first_of("/?#", begin));
+    if (end == std::string::npos) end = url.size();
+
+    const std::size_t at(url.rfind('@', end));
+    if (at != std::string::npos && at >= begin) begin = at + 1;
+
+    std::string host(url.substr(begin, end - begin));
+    std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+    return host;
+}
+
+std::string flightKey(const Request& req)
+{
+    // Headers which date or sign a request differ between otherwise
+    // identical ones made moments apart, without changing the response.
+    static const std::set<std::string> signing{
+        "authorization", "date", "x-amz-content-sha256", "x-amz-date",
+        "x-ms-date" };
+
+    std::string key(req.verb == Request::Verb::GET ? "GET " : "HEAD ");
+    key += req.path + buildQueryString(req.query);
+    key += "\npriority " + std::to_string(static_cast<int>(req.priority));
+    key += "\nretry " + std::to_string(req.retry);
+    key += "\ntimeout " + std::to_string(req.timeout);
+    for (const auto& h : req.headers)
+    {
+        std::string name(h.first);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (!signing.count(name)) key += '\n' + name + ": " + h.second;
+    }
+    return key;
+}
+
+Sink fdSink(const int fd)
+{
+    return [fd](const char* data, std::size_t size)
+    {
+        while (size)
+        {
+#ifndef ARBITER_WINDOWS
+            const auto n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+#else
+            const auto n = ::_write(fd, data, (unsigned int)size);
+#endif
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    };
+}
+
+Sink bufferSink(char* const out, const std::size_t capacity)
+{
+    std::size_t offset(0);
+    return [out, capacity, offset](const char* data, std::size_t size) mutable
+    {
+        if (size > capacity - offset) return false;
+        std::memcpy(out + offset, data, size);
+        offset += size;
+        return true;
+    };
+}
+
+PriorityScope::PriorityScope(const std::optional<Priority> priority)
+    : m_prev(threadPriority)
+{
+    if (priority) threadPriority = *priority;
+}
+
+PriorityScope::~PriorityScope()
+{
+    threadPriority = m_prev;
+}
+
+Priority PriorityScope::current()
+{
+    return threadPriority;
+}
+
+CancellationScope::CancellationScope(Cancellation cancel)
+    : m_prev(threadCancellation)
+{
+    threadCancellation = std::move(cancel);
+}
+
+CancellationScope::~CancellationScope()
+{
+    threadCancellation = m_prev;
+}
+
+Cancellation CancellationScope::current()
+{
+    return threadCancellation;
+}
+
 Resource::Resource(
         Pool& pool,
-        Curl& curl,
-        const std::size_t retry)
+        const Priority priority,
+        const Cancellation cancel)
     : m_pool(pool)
-    , m_curl(curl)
-    , m_retry(retry)
+    , m_priority(priority)
+    , m_cancel(cancel)
 { }
 
-Resource::~Resource()
+Response Resource::get(
+        const std::string path,
+        const Headers headers,
+        const Query query,
+        const std::size_t reserve,
+        const int retry,
+        const std::size_t timeout)
 {
-    m_pool.release(m_curl);
+    Request req;
+    req.verb = Request::Verb::GET;
+    req.path = path;
+    req.headers = headers;
+    req.query = query;
+    req.reserve = reserve;
+    req.retry = retry;
+    req.timeout = timeout;
+    return exec(std::move(req));
 }
 
 Response Resource::get(
         const std::string path,
+        Sink sink,
         const Headers headers,
         const Query query,
-        const std::size_t reserve,
         const int retry,
         const std::size_t timeout)
 {
-    return exec([this, path, headers, query, reserve, timeout]()->Response
-    {
-        m_curl.prepareGet(path, headers, query, reserve, timeout);
-        m_pool.perform(m_curl);
-        return m_curl.response();
-    }, retry);
+    Request req;
+    req.verb = Request::Verb::GET;
+    req.path = path;
+    req.headers = headers;
+    req.query = query;
+    req.sink = std::move(sink);
+    req.retry = retry;
+    req.timeout = timeout;
+    return exec(std::move(req));
 }
 
 Response Resource::head(
@@ -107,12 +367,12 @@ Response Resource::head(
         const Headers headers,
         const Query query)
 {
-    return exec([this, path, headers, query]()->Response
-    {
-        m_curl.prepareHead(path, headers, query);
-        m_pool.perform(m_curl);
-        return m_curl.response();
-    });
+    Request req;
+    req.verb = Request::Verb::HEAD;
+    req.path = path;
+    req.headers = headers;
+    req.query = query;
+    return exec(std::move(req));
 }
 
 Response Resource::put(
@@ -123,12 +383,16 @@ Response Resource::put(
         const int retry,
         const std::size_t timeout)
 {
-    return exec([this, path, &data, headers, query, timeout]()->Response
-    {
-        m_curl.preparePut(path, data, headers, query, timeout);
-        m_pool.perform(m_curl);
-        return m_curl.response();
-    }, retry);
+    Request req;
+    req.verb = Request::Verb::PUT;
+    req.path = path;
+    req.headers = headers;
+    req.query = query;
+    // The caller's data outlives the request since this blocks until done.
+    req.data = Body(data.data(), data.size());
+    req.retry = retry;
+    req.timeout = timeout;
+    return exec(std::move(req));
 }
 
 Response Resource::post(
@@ -137,36 +401,34 @@ Response Resource::post(
         const Headers headers,
         const Query query)
 {
-    return exec([this, path, &data, headers, query]()->Response
-    {
-        m_curl.preparePost(path, data, headers, query);
-        m_pool.perform(m_curl);
-        return m_curl.response();
-    });
+    Request req;
+    req.verb = Request::Verb::POST;
+    req.path = path;
+    req.headers = headers;
+    req.query = query;
+    req.data = Body(data.data(), data.size());
+    return exec(std::move(req));
 }
 
-Response Resource::exec(std::function<Response()> f, const int userRetry)
+Response Resource::del(
+        const std::string path,
+        const Headers headers,
+        const Query query)
 {
-    Response res;
-    std::size_t tries(0);
-
-    const std::size_t retry = userRetry == -1
-        ? m_retry
-        : static_cast<std::size_t>(userRetry);
-
-    do
-    {
-        if (tries)
-        {
-            std::this_thread::sleep_for(
-                std::chrono::milliseconds((int)std::pow(2, tries) * 500));
-        }
-
-        res = f();
-    }
-    while (res.serverError() && tries++ < retry);
+    Request req;
+    req.verb = Request::Verb::DEL;
+    req.path = path;
+    req.headers = headers;
+    req.query = query;
+    return exec(std::move(req));
+}
 
-    return res;
+// Retries are scheduled by the Pool, so this just waits for the outcome.
+Response Resource::exec(Request req)
+{
+    req.priority = m_priority;
+    req.cancel = m_cancel;
+    return m_pool.submit(std::move(req)).get();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -176,185 +438,1380 @@ Pool::Pool(
         const std::size_t retry,
         const std::string& config)
     : m_retry(retry)
+    , m_config(config)
+    , m_max(concurrent)
+    , m_rng(std::random_device()())
 {
+    std::string runner("poll");
+    std::size_t shards(1);
+    bool http2(false);
+
+    auto rateConfig([](const json& j, HostConfig c)
+    {
+        c.requestsPerSecond = j.value("requestsPerSecond", c.requestsPerSecond);
+        c.recvBytesPerSecond =
+            j.value("recvBytesPerSecond", c.recvBytesPerSecond);
+        c.sendBytesPerSecond =
+            j.value("sendBytesPerSecond", c.sendBytesPerSecond);
+        if (c.requestsPerSecond < 0 ||
+            c.recvBytesPerSecond < 0 ||
+            c.sendBytesPerSecond < 0)
+        {
+            throw ArbiterError("HTTP rate limits must not be negative");
+        }
+        return c;
+    });
+
+    auto hostConfig([&rateConfig](const json& j, HostConfig c)
+    {
+        c.concurrent = j.value("concurrent", c.concurrent);
+        c.weight = j.value("weight", c.weight);
+        if (!(c.weight > 0))
+            throw ArbiterError("HTTP host weights must be positive");
+        return rateConfig(j, c);
+    });
+
+    // Only the rates are used for the pool as a whole.
+    HostConfig rates;
+
+    const json c(config.size() ? json::parse(config) : json::object());
+    if (c.is_object())
+    {
+        const json h(c.value("http", json::object()));
+        if (h.is_object())
+        {
+            m_min = h.value("minConcurrent", m_min);
+            m_idleTimeout = std::chrono::seconds(
+                h.value("idleTimeout", (long long)m_idleTimeout.count()));
+            runner = h.value("runner", runner);
+            shards = h.value("shards", shards);
+            m_bufferCache = h.value("bufferCache", m_bufferCache);
+            http2 = h.value("http2", http2) || h.value("h2c", false);
+            m_hostConfig.concurrent =
+                h.value("hostConcurrent", m_hostConfig.concurrent);
+            m_adaptive = h.value("adaptive", m_adaptive);
+            m_hedge = h.value("hedge", m_hedge);
+            m_coalesce = h.value("coalesce", m_coalesce);
+            rates = rateConfig(h, rates);
+            m_adaptiveLatency =
+                h.value("adaptiveLatency", m_adaptiveLatency);
+
+            const auto hosts(h.find("hosts"));
+            if (hosts != h.end() && hosts->is_object())
+            {
+                for (const auto& p : hosts->items())
+                {
+                    std::string host(p.key());
+                    std::transform(
+                        host.begin(), host.end(), host.begin(), ::tolower);
+                    m_hostConfigs[host] = hostConfig(p.value(), m_hostConfig);
+                }
+            }
+        }
+    }
+
+    if (auto v = env("ARBITER_HTTP_MIN_CONCURRENT")) m_min = std::stoul(*v);
+    if (auto v = env("ARBITER_HTTP_IDLE_TIMEOUT"))
+        m_idleTimeout = std::chrono::seconds(std::stoll(*v));
+    if (auto v = env("ARBITER_HTTP_RUNNER")) runner = *v;
+    if (auto v = env("ARBITER_HTTP_SHARDS")) shards = std::stoul(*v);
+    if (auto v = env("ARBITER_HTTP_BUFFER_CACHE"))
+        m_bufferCache = std::stoull(*v);
+    if (auto v = env("ARBITER_HTTP2")) http2 = !!std::stol(*v);
+    if (auto v = env("ARBITER_H2C")) http2 = http2 || !!std::stol(*v);
+    if (auto v = env("ARBITER_HTTP_HOST_CONCURRENT"))
+        m_hostConfig.concurrent = std::stoul(*v);
+    if (auto v = env("ARBITER_HTTP_ADAPTIVE")) m_adaptive = !!std::stol(*v);
+    if (auto v = env("ARBITER_HTTP_HEDGE")) m_hedge = std::stod(*v);
+    if (auto v = env("ARBITER_HTTP_COALESCE")) m_coalesce = !!std::stol(*v);
+    if (auto v = env("ARBITER_HTTP_REQUESTS_PER_SECOND"))
+        rates.requestsPerSecond = std::stod(*v);
+    if (auto v = env("ARBITER_HTTP_RECV_BYTES_PER_SECOND"))
+        rates.recvBytesPerSecond = std::stod(*v);
+    if (auto v = env("ARBITER_HTTP_SEND_BYTES_PER_SECOND"))
+        rates.sendBytesPerSecond = std::stod(*v);
+
+    m_limits = Limits(rates);
+    m_limited = m_limits.any() || std::any_of(
+        m_hostConfigs.begin(),
+        m_hostConfigs.end(),
+        [](const std::pair<const std::string, HostConfig>& p)
+        {
+            return Limits(p.second).any();
+        });
+
+    if (runner != "poll" && runner != "epoll")
+    {
+        throw ArbiterError("Invalid HTTP runner: " + runner);
+    }
+
+    if (m_hedge < 0 || m_hedge >= 100)
+    {
+        throw ArbiterError("HTTP hedge percentile must be in [0, 100)");
+    }
+
+    // A shard with no handles would never have anything to do.
+    shards = (std::max)((std::size_t)1, (std::min)(shards, m_max));
+
     curl_global_init(CURL_GLOBAL_ALL);
-    for (std::size_t i = 0; i < concurrent; ++i)
-        m_curls.emplace_back(i, config);
-    m_multi = curl_multi_init();
-    m_runner = std::thread(&Pool::run, this);
+
+    for (std::size_t i(0); i < shards; ++i)
+    {
+        m_shards.push_back(std::make_unique<Shard>());
+        Shard& shard(*m_shards.back());
+        shard.index = i;
+        shard.multi = curl_multi_init();
+        if (http2)
+        {
+            curl_multi_setopt(
+                shard.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        }
+
+#ifdef __linux__
+        if (runner == "epoll")
+        {
+            shard.epoll = epoll_create1(EPOLL_CLOEXEC);
+            shard.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = shard.wakeFd;
+
+            if (shard.epoll < 0 || shard.wakeFd < 0 ||
+                epoll_ctl(shard.epoll, EPOLL_CTL_ADD, shard.wakeFd, &ev) != 0)
+            {
+                for (auto& s : m_shards) close(*s);
+                throw ArbiterError("Could not create the epoll HTTP runner");
+            }
+
+            curl_multi_setopt(
+                shard.multi, CURLMOPT_SOCKETFUNCTION, &Pool::onSocket);
+            curl_multi_setopt(shard.multi, CURLMOPT_SOCKETDATA, &shard);
+            curl_multi_setopt(
+                shard.multi, CURLMOPT_TIMERFUNCTION, &Pool::onTimer);
+            curl_multi_setopt(shard.multi, CURLMOPT_TIMERDATA, &shard);
+        }
+#endif
+    }
+
+    for (auto& shard : m_shards)
+    {
+        shard->runner = std::thread(
+            shard->epoll >= 0 ? &Pool::runEvents : &Pool::run,
+            this,
+            std::ref(*shard));
+    }
 }
 
 Pool::~Pool()
 {
     m_stop = true;
     wakeup();
-    m_runner.join();
+    for (auto& shard : m_shards)
+        shard->runner.join();
 
-    std::lock_guard l(m_mutex);
-    for (size_t i = 0; i < m_curls.size(); ++i)
-        curl_multi_remove_handle(m_multi, m_curls[i].m_curl);
+    Completions completions;
+    {
+        std::lock_guard l(m_mutex);
+        for (auto& curl : m_curls)
+            if (curl->m_curl)
+                curl_multi_remove_handle(shardOf(*curl).multi, curl->m_curl);
+
+        // Anything submitted but not yet finished completes with no response,
+        // once for each hedged request.
+        auto abandon([&completions](Transfer& t)
+        {
+            if (t.race && t.race->done) return;
+            if (t.race) t.race->done = true;
+            completions.emplace_back(std::move(t.cb), Response());
+        });
+
+        for (auto& t : m_transfers)
+            if (t)
+                abandon(*t);
+        for (auto& q : m_queues)
+            for (auto& p : q.second.pending)
+                for (auto& t : p)
+                    abandon(t);
+        for (auto& p : m_delayed)
+            abandon(p.second);
+        m_transfers.clear();
+        m_delayed.clear();
+        m_queues.clear();
+
+        // This deletes all the curl objects and does curl_easy_cleanup.
+        m_curls.clear();
+        for (auto& shard : m_shards)
+            close(*shard);
+    }
+
+    for (auto& c : completions)
+        c.first(std::move(c.second));
+}
+
+// Release the multi handle and descriptors of a shard whose runner is stopped.
+void Pool::close(Shard& shard)
+{
+    if (shard.multi)
+        curl_multi_cleanup(shard.multi);
+    shard.multi = nullptr;
 
-    // This deletes all the curl objects and does curl_easy_cleanup.
-    m_curls.clear();
-    curl_multi_cleanup(m_multi);
+#ifdef __linux__
+    if (shard.epoll >= 0) ::close(shard.epoll);
+    if (shard.wakeFd >= 0) ::close(shard.wakeFd);
+#endif
+    shard.epoll = -1;
+    shard.wakeFd = -1;
 }
 
-// Thread that performs the curl activity. Runs until told to stop.
-void Pool::run()
+// Thread that performs the curl activity of a shard. Runs until told to stop.
+void Pool::run(Shard& shard)
 {
     while (true)
     {
         if (m_stop)
             break;
 
+        reap();
+
         // Add ready transfers to the multi handle to run. If there is nothing to run, wait
         // for the 1 sec. timeout. If a new handle is added, the poll will break before
         // the 1 sec. timeout (see wakeup())
-        if (handleReady() == 0)
+        if (handleReady(shard) == 0)
         {
-            curl_multi_poll(m_multi, NULL, 0, 1000, NULL);
+            curl_multi_poll(shard.multi, NULL, 0, pollTimeout(shard, 1000), NULL);
             continue;
         }
 
         int stillRunning;
-        CURLMcode result = curl_multi_perform(m_multi, &stillRunning);
+        CURLMcode result = curl_multi_perform(shard.multi, &stillRunning);
         if (result == CURLM_OK && stillRunning)
-            result = curl_multi_poll(m_multi, NULL, 0, 200, NULL);
+            result = curl_multi_poll(shard.multi, NULL, 0, pollTimeout(shard, 200), NULL);
 
-        bool notify;
         if (result != CURLM_OK)
-            notify = handleFailure();
+            handleFailure(shard);
         else
-            notify = handleCompleted();
-
-        // If any threads have completed, notify waiters.
-        if (notify)
-            m_poolCv.notify_all();
+            handleCompleted(shard);
     }
 }
 
-// For any any transfers that are ready, set the state to running, clear the code and
-// add the handle.
-int Pool::handleReady()
+// Alternative to run which only services the sockets that have activity.
+// Curl tells us which sockets to watch, and when it next needs to be called
+// regardless of activity, through onSocket and onTimer.
+void Pool::runEvents(Shard& shard)
 {
-    std::lock_guard l(m_mutex);
+#ifdef __linux__
+    epoll_event events[64];
 
-    int runningCount = 0;
-    for (Curl& curl : m_curls)
+    while (!m_stop)
     {
-        if (curl.m_state == Curl::State::READY)
+        reap();
+
+        // Adding a handle arms curl's timer, which kicks off the transfer.
+        handleReady(shard);
+
+        int timeout = pollTimeout(shard, 1000);
+        if (shard.timerSet)
         {
-            curl.m_state = Curl::State::RUNNING;
-            curl.m_code = 0;
-            curl_multi_add_handle(m_multi, curl.m_curl);
+            const auto wait =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    shard.timer - Clock::now()).count();
+            timeout = (int)(std::max)(
+                (long long)0, (std::min)((long long)timeout, (long long)wait));
         }
-        runningCount += (curl.m_state == Curl::State::RUNNING);
-    }
-    return runningCount;
-}
 
-// See if any curl requests completed. If so, mark the state as DONE.
-bool Pool::handleCompleted()
-{
-    bool notify = false;
-    while (true)
-    {
-        int msgCnt;
-        CURLMsg *m = curl_multi_info_read(m_multi, &msgCnt);
-        if (!m)
-            break;
-        if (m->msg != CURLMSG_DONE)
-            continue;
+        const int n = epoll_wait(shard.epoll, events, 64, timeout);
 
-        // If we have a completed transfer, set the state to done, update the http code
-        // and say we should notify.
-        curl_multi_remove_handle(m_multi, m->easy_handle);
-        std::lock_guard l(m_mutex);
-        for (Curl& curl : m_curls)
-            if (curl.m_curl == m->easy_handle)
+        int running = 0;
+        CURLMcode result = CURLM_OK;
+        for (int i = 0; i < n && result == CURLM_OK; ++i)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == shard.wakeFd)
             {
-                curl.m_state = Curl::State::DONE;
-                curl_easy_getinfo(curl.m_curl, CURLINFO_RESPONSE_CODE, &curl.m_code);
-                notify = true;
+                std::uint64_t count;
+                if (::read(shard.wakeFd, &count, sizeof(count)) < 0) { }
+                continue;
             }
+
+            int mask = 0;
+            if (events[i].events & EPOLLIN) mask |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT) mask |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                mask |= CURL_CSELECT_ERR;
+            result = curl_multi_socket_action(shard.multi, fd, mask, &running);
+        }
+
+        if (result == CURLM_OK && shard.timerSet && Clock::now() >= shard.timer)
+        {
+            // Curl may re-arm the timer from within this call.
+            shard.timerSet = false;
+            result = curl_multi_socket_action(
+                shard.multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+
+        if (result != CURLM_OK)
+            handleFailure(shard);
+        else
+            handleCompleted(shard);
     }
-    return notify;
+#endif
 }
 
-// Abort all the running transfers as curl has failed internally. Remove the handle.
-// Set the state to done. Update the http code and return the notification state.
-bool Pool::handleFailure()
+// Curl's request to watch socket @p s for the events in @p what, or to stop
+// watching it.  Sockets already being watched are marked with a non-null
+// @p known pointer via curl_multi_assign.
+int Pool::onSocket(
+        CURL*,
+        const curl_socket_t s,
+        const int what,
+        void* const data,
+        void* const known)
 {
-    bool notify = false;
+#ifdef __linux__
+    Shard& shard = *static_cast<Shard*>(data);
 
-    std::lock_guard l(m_mutex);
-    for (Curl& curl : m_curls)
-        if (curl.m_state == Curl::State::RUNNING)
+    if (what == CURL_POLL_REMOVE)
+    {
+        // This fails harmlessly if the socket has already been closed.
+        epoll_ctl(shard.epoll, EPOLL_CTL_DEL, s, nullptr);
+        return 0;
+    }
+
+    epoll_event ev{};
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+
+    if (known)
+    {
+        if (epoll_ctl(shard.epoll, EPOLL_CTL_MOD, s, &ev) != 0 &&
+            errno == ENOENT)
+        {
+            epoll_ctl(shard.epoll, EPOLL_CTL_ADD, s, &ev);
+        }
+    }
+    else
+    {
+        if (epoll_ctl(shard.epoll, EPOLL_CTL_ADD, s, &ev) != 0 &&
+            errno == EEXIST)
         {
-            curl_multi_remove_handle(m_multi, curl.m_curl);
-            curl.m_state = Curl::State::DONE;
-            curl.m_code = 550;  // Made-up error code.
-            notify = true;
+            epoll_ctl(shard.epoll, EPOLL_CTL_MOD, s, &ev);
         }
-    return notify;
+        curl_multi_assign(shard.multi, s, &shard);
+    }
+#endif
+    return 0;
 }
 
-// Wakeup the run thread.
-void Pool::wakeup()
+// Curl's request to be called after @p ms milliseconds even if no socket has
+// activity.  A negative value cancels the timer.
+int Pool::onTimer(CURLM*, const long ms, void* const data)
 {
-    curl_multi_wakeup(m_multi);
+    Shard& shard = *static_cast<Shard*>(data);
+    shard.timerSet = ms >= 0;
+    if (ms >= 0) shard.timer = Clock::now() + std::chrono::milliseconds(ms);
+    return 0;
 }
 
-// Acquire a resource (a curl easy handle) from the pool.
-Resource Pool::acquire()
+// Shorten the poll timeout so that no delayed retry, rate-limited transfer,
+// deadline or hedge of this shard waits past its due time.
+int Pool::pollTimeout(Shard& shard, const int maxMs)
 {
-    if (m_curls.empty())
-        throw std::runtime_error("Cannot acquire from empty pool");
+    std::lock_guard l(m_mutex);
+    if (shard.cancels.size() || shard.sweep)
+        return 0;
+
+    auto at = (std::min)(m_rateWake, m_deadline);
+    if (m_delayed.size()) at = (std::min)(at, m_delayed.begin()->first);
+    if (shard.hedges.size()) at = (std::min)(at, shard.hedges.begin()->first);
+    if (at == Clock::time_point::max())
+        return maxMs;
+
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        at - Clock::now()).count();
+    return (int)(std::max)((long long)0, (std::min)((long long)maxMs, (long long)wait));
+}
 
-    Curl *foundCurl = nullptr;
+// Add the handles queued as ready for this shard to its multi handle, preparing
+// those bound to submitted transfers.  Retries whose backoff has elapsed are
+// requeued first, and transfers held back by rate limits are reconsidered, by
+// whichever runner gets to them.
+int Pool::handleReady(Shard& shard)
+{
+    Completions completions;
+    std::unique_lock l(m_mutex);
+
+    if (shard.cancels.size() || shard.hedges.size()) hedge(shard, completions);
+
+    const auto now = Clock::now();
+    if (shard.sweep || m_deadline <= now) sweep(shard, completions);
+
+    if ((m_delayed.size() && m_delayed.begin()->first <= now) ||
+        m_rateWake <= now)
+    {
+        while (m_delayed.size() && m_delayed.begin()->first <= now)
+        {
+            enqueue(std::move(m_delayed.begin()->second));
+            m_delayed.erase(m_delayed.begin());
+        }
 
-    // Wait until we find an unused Curl object. If we find one, mark
-    // it acquired.
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_cv.wait(lock, [this, &foundCurl]()
+        // Anything still held back by a rate limit sets this again.
+        m_rateWake = Clock::time_point::max();
+        dispatch();
+    }
+
+    while (shard.ready.size())
     {
-        for (Curl& curl : m_curls)
+        Curl& curl = *shard.ready.front();
+        shard.ready.pop_front();
+
+        if (const auto& transfer = m_transfers[curl.id()])
         {
-            if (curl.m_state == Curl::State::UNUSED)
+            transfer->started = now;
+            const Request& req(transfer->req);
+            // Bodies of unknown length take recycled storage once their
+            // length arrives in the response headers.
+            const bool recycled(
+                req.verb == Request::Verb::GET && !req.sink && m_bufferCache);
+            if (recycled && req.reserve && m_buffers.size())
+                curl.m_response.useBuffer(unstash(req.reserve));
+            curl.prepare(req);
+            if (recycled)
             {
-                curl.m_state = Curl::State::ACQUIRED;
-                foundCurl = &curl;
-                return true;
+                curl.m_response.useSource([this](std::size_t size)
+                {
+                    std::lock_guard l(m_mutex);
+                    return unstash(size);
+                });
             }
+            if (m_limited) limit(curl, *transfer->queue);
+
+            // Hold the attempt to what is left before the deadline, if any.
+            const auto deadline(req.cancel.deadline());
+            const long long left = deadline == Clock::time_point::max()
+                ? 0
+                : (std::max)(1LL, (long long)std::chrono::duration_cast<
+                    std::chrono::milliseconds>(deadline - now).count());
+            curl_easy_setopt(curl.m_curl, CURLOPT_TIMEOUT_MS, (long)left);
+
+            // Hedged requests are not hedged again.
+            if (m_hedgeDelay.count() && hedgeable(req) && !transfer->race)
+                shard.hedges.emplace(now + m_hedgeDelay, std::make_pair(&curl, now));
         }
-        return false;
-     });
+        curl.m_state = Curl::State::RUNNING;
+        curl.m_code = 0;
+        curl_multi_add_handle(shard.multi, curl.m_curl);
+        ++shard.running;
+    }
 
-    // Return the resource with the acquired Curl.
-    return Resource(*this, *foundCurl, m_retry);
+    const int running(shard.running);
+    l.unlock();
+
+    for (auto& c : completions)
+        c.first(std::move(c.second));
+    return running;
 }
 
-// Release a curl handle.
-void Pool::release(Curl& curl)
+// Stop the attempts of this shard which lost a race, and hedge those which
+// have gone without a response for longer than the hedging delay.  Hedges
+// only use handles which no pending transfer could have, and only run within
+// the rate limits.  Must be called with the lock held, from the runner of the
+// shard.
+void Pool::hedge(Shard& shard, Completions& completions)
 {
+    for (auto& c : shard.cancels)
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_curls[curl.id()].m_state = Curl::State::UNUSED;
+        Curl& curl(*c.first);
+        const auto& transfer(m_transfers[curl.id()]);
+        if (transfer && transfer->race == c.second)
+            abort(shard, curl, completions);
     }
+    shard.cancels.clear();
 
-    m_cv.notify_one();
-}
-
-void Pool::perform(Curl& curl)
-{
-    std::unique_lock l(m_mutex);
-    curl.m_state = Curl::State::READY;
-    wakeup();
-    // Wait until the operation is done or a non-recoverable error occurs.
-    m_poolCv.wait(l, [&curl]()
+    const auto now = Clock::now();
+    while (shard.hedges.size() && shard.hedges.begin()->first <= now)
     {
-        return curl.m_state == Curl::State::DONE;
-    });
+        Curl& curl(*shard.hedges.begin()->second.first);
+        const auto started(shard.hedges.begin()->second.second);
+        shard.hedges.erase(shard.hedges.begin());
+
+        Transfer* original(m_transfers[curl.id()].get());
+        if (curl.m_state != Curl::State::RUNNING ||
+            !original ||
+            original->started != started ||
+            original->queue->full() ||
+            next())
+        {
+            continue;
+        }
+
+        curl_off_t start = 0;
+        curl_easy_getinfo(curl.m_curl, CURLINFO_STARTTRANSFER_TIME_T, &start);
+        if (start) continue;
+
+        // A hedge is another request as far as rate limits go, so skip it
+        // if the host or the pool has no request to spare.
+        Queue& queue(*original->queue);
+        if (m_limited && (
+                !admits(queue.limits, original->req, now) ||
+                !admits(m_limits, original->req, now)))
+        {
+            continue;
+        }
+
+        Curl* other = take();
+        if (!other) continue;
+
+        if (m_limited)
+        {
+            queue.limits.requests.take(1);
+            m_limits.requests.take(1);
+        }
+
+        original->race = std::make_shared<Race>();
+        original->race->curls = { &curl, other };
+
+        // Whichever attempt fails last is the one to be retried.
+        Transfer copy;
+        copy.req = original->req;
+        copy.cb = original->cb;
+        copy.tries = original->tries;
+        copy.backoff = original->backoff;
+        copy.queue = original->queue;
+        copy.race = original->race;
+        ++copy.queue->transfers;
+        bind(*other, std::move(copy));
+    }
+}
+
+// Drop the transfers waiting for a Curl or a retry whose Cancellation has
+// fired, and stop those of this shard which are running.  Waiting ones go
+// first, so that none of them is handed a Curl freed here.  Must be called
+// with the lock held, from the runner of the shard.
+void Pool::sweep(Shard& shard, Completions& completions)
+{
+    for (auto it = m_delayed.begin(); it != m_delayed.end(); )
+    {
+        Transfer& transfer(it->second);
+        if (!transfer.req.cancel.cancelled())
+        {
+            ++it;
+            continue;
+        }
+
+        Queue& queue(*transfer.queue);
+        completions.emplace_back(std::move(transfer.cb), Response());
+        it = m_delayed.erase(it);
+        --queue.transfers;
+        retire(queue);
+    }
+
+    m_deadline = Clock::time_point::max();
+    for (auto it = m_queues.begin(); it != m_queues.end(); )
+    {
+        // Retiring the queue would invalidate the iterator.
+        Queue& queue(it++->second);
+        for (auto& pending : queue.pending)
+        {
+            for (auto t = pending.begin(); t != pending.end(); )
+            {
+                if (t->req.cancel.cancelled())
+                {
+                    completions.emplace_back(std::move(t->cb), Response());
+                    t = pending.erase(t);
+                    --queue.transfers;
+                }
+                else
+                {
+                    m_deadline = (std::min)(m_deadline, t->req.cancel.deadline());
+                    ++t;
+                }
+            }
+        }
+        retire(queue);
+    }
+
+    if (!shard.sweep) return;
+    shard.sweep = false;
+
+    for (auto& c : m_curls)
+    {
+        Curl& curl(*c);
+        const auto& transfer(m_transfers[curl.id()]);
+        if (curl.m_shard == shard.index &&
+            transfer &&
+            transfer->req.cancel.cancelled())
+        {
+            abort(shard, curl, completions);
+        }
+    }
+}
+
+// Stop the transfer on @p curl, of this shard, whether or not its runner has
+// started it, and finish it as aborted.  Must be called with the lock held,
+// from the runner of the shard.
+void Pool::abort(Shard& shard, Curl& curl, Completions& completions)
+{
+    if (curl.m_state == Curl::State::RUNNING)
+    {
+        curl_multi_remove_handle(shard.multi, curl.m_curl);
+        --shard.running;
+    }
+    else if (curl.m_state == Curl::State::ACQUIRED)
+    {
+        auto& ready(shard.ready);
+        ready.erase(std::remove(ready.begin(), ready.end(), &curl), ready.end());
+    }
+    else return;
+
+    curl.m_state = Curl::State::DONE;
+    curl.m_code = 0;
+    finish(curl, CURLE_ABORTED_BY_CALLBACK, completions);
+}
+
+// See if any curl requests completed. If so, mark the state as DONE and finish
+// the submitted transfer.
+void Pool::handleCompleted(Shard& shard)
+{
+    Completions completions;
+    while (true)
+    {
+        int msgCnt;
+        CURLMsg *m = curl_multi_info_read(shard.multi, &msgCnt);
+        if (!m)
+            break;
+        if (m->msg != CURLMSG_DONE)
+            continue;
+
+        char *priv = nullptr;
+        curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, &priv);
+        Curl& curl = *reinterpret_cast<Curl *>(priv);
+
+        // A transfer cut off partway through may have a status code, but
+        // its response is incomplete.
+        const CURLcode result = m->data.result;
+        curl_multi_remove_handle(shard.multi, m->easy_handle);
+
+        std::lock_guard l(m_mutex);
+        --shard.running;
+        curl.m_state = Curl::State::DONE;
+        if (result == CURLE_OK)
+            curl_easy_getinfo(curl.m_curl, CURLINFO_RESPONSE_CODE, &curl.m_code);
+        else
+            curl.m_code = 0;
+        finish(curl, result, completions);
+    }
+
+    for (auto& c : completions)
+        c.first(std::move(c.second));
+}
+
+// Abort all the running transfers of this shard as curl has failed internally.
+// Remove the handle.  Set the state to done, update the http code and finish
+// the transfers, which are retried like any server error.
+void Pool::handleFailure(Shard& shard)
+{
+    Completions completions;
+
+    {
+        std::lock_guard l(m_mutex);
+        for (auto& c : m_curls)
+        {
+            Curl& curl = *c;
+            if (curl.m_shard == shard.index &&
+                curl.m_state == Curl::State::RUNNING)
+            {
+                curl_multi_remove_handle(shard.multi, curl.m_curl);
+                --shard.running;
+                curl.m_state = Curl::State::DONE;
+                curl.m_code = 550;  // Made-up error code.
+                finish(curl, CURLE_OK, completions);
+            }
+        }
+    }
+
+    for (auto& c : completions)
+        c.first(std::move(c.second));
+}
+
+// Complete a submitted transfer whose Curl is DONE.  Retryable failures are
+// rescheduled after a backoff, otherwise the completion is queued up to be
+// invoked once the lock is released.  Either way the Curl is handed off to
+// its next user.  Must be called with the lock held.
+void Pool::finish(Curl& curl, const CURLcode result, Completions& completions)
+{
+    std::unique_ptr<Transfer> transfer(std::move(m_transfers[curl.id()]));
+    Queue& queue(*transfer->queue);
+    --queue.active;
+    --m_active;
+    if (queue.window.size) adapt(queue, *transfer, curl);
+
+    if (m_limited)
+    {
+        curl_off_t size = 0;
+        curl_easy_getinfo(curl.m_curl, CURLINFO_SIZE_DOWNLOAD_T, &size);
+        m_limits.recv.take(static_cast<double>(size));
+        queue.limits.recv.take(static_cast<double>(size));
+    }
+
+    if (m_hedge && hedgeable(transfer->req) && curl.m_code / 100 == 2)
+        sample(curl);
+
+    Response res(curl.response());
+
+    // Let go of the upload body, which may be large and shared.
+    curl.m_putData.init(Body());
+
+    // An attempt which lost its race is dropped.
+    const bool stands = !transfer->race || race(curl, *transfer, res.ok());
+
+    const std::size_t retry = transfer->req.retry < 0
+        ? m_retry
+        : static_cast<std::size_t>(transfer->req.retry);
+
+    // Bytes already handed to a sink can't be taken back.
+    const bool retryable = !res.delivered() &&
+        !transfer->req.cancel.cancelled() && (
+            res.serverError() ||
+            res.code() == 429 ||
+            (res.code() == 0 && resendable(transfer->req, result)));
+
+    // Don't bother with a retry which could not start before the deadline.
+    bool again = stands && retryable && transfer->tries++ < retry;
+    Clock::time_point at;
+    if (again)
+    {
+        at = Clock::now() + backoff(*transfer, res);
+        again = at < transfer->req.cancel.deadline();
+    }
+
+    if (again)
+    {
+        stash(res.data());
+        transfer->race.reset();
+        m_delayed.emplace(at, std::move(*transfer));
+    }
+    else
+    {
+        if (!stands)
+        {
+            stash(res.data());
+        }
+        else
+        {
+            if (transfer->race) settle(*transfer->race);
+            completions.emplace_back(std::move(transfer->cb), std::move(res));
+        }
+
+        --queue.transfers;
+        retire(queue);
+    }
+
+    hand(curl);
+
+    // A window that grew may have room for more than the one transfer this
+    // Curl was handed.
+    if (m_adaptive) dispatch();
+}
+
+// Forget @p queue if it has no more outstanding transfers.  A host whose
+// window is still shrunk keeps its queue, so that the next transfers to it
+// don't start out at full concurrency.  So does one with rate limits, which
+// must not forget what it has used.  Must be called with the lock held.
+void Pool::retire(Queue& queue)
+{
+    if (!queue.transfers &&
+        queue.window.size >= queue.window.max &&
+        !queue.limits.any())
+    {
+        m_queues.erase(queue.host);
+    }
+}
+
+// Take the attempt of a hedged @p transfer on @p curl out of its race,
+// returning whether its outcome stands.  It does unless another attempt has
+// already won, or it failed while another attempt is still running.  Must be
+// called with the lock held.
+bool Pool::race(Curl& curl, Transfer& transfer, const bool ok)
+{
+    Race& r(*transfer.race);
+    r.curls.erase(std::remove(r.curls.begin(), r.curls.end(), &curl), r.curls.end());
+    return !r.done && (ok || r.curls.empty());
+}
+
+// Declare a winner for @p race, cancelling the attempts still running.  Must
+// be called with the lock held.
+void Pool::settle(Race& race)
+{
+    race.done = true;
+    for (Curl* curl : race.curls)
+    {
+        Shard& shard(shardOf(*curl));
+        shard.cancels.emplace_back(curl, m_transfers[curl->id()]->race);
+        wakeup(shard);
+    }
+}
+
+// Record the time to first byte of a successful attempt which might have
+// been hedged, and now and then refresh the hedging delay from the recent
+// ones.  Must be called with the lock held.
+void Pool::sample(Curl& curl)
+{
+    static constexpr std::size_t window = 256;
+
+    curl_off_t start = 0;
+    curl_easy_getinfo(curl.m_curl, CURLINFO_STARTTRANSFER_TIME_T, &start);
+    if (start <= 0) return;
+
+    const std::chrono::microseconds latency(start);
+    if (m_latencies.size() < window) m_latencies.push_back(latency);
+    else m_latencies[m_latency % window] = latency;
+
+    // Don't guess at the tail from only a few samples.
+    if (++m_latency < 32 || m_latency % 16) return;
+
+    std::vector<std::chrono::microseconds> sorted(m_latencies);
+    const auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(
+        m_hedge / 100 * static_cast<double>(sorted.size()));
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    m_hedgeDelay = (std::max)(
+        Clock::duration(*nth),
+        Clock::duration(std::chrono::milliseconds(1)));
+}
+
+// Resize the concurrency window of @p queue following the completion of
+// @p transfer on @p curl, whose response has not yet been taken.  Must be
+// called with the lock held.
+void Pool::adapt(Queue& queue, const Transfer& transfer, Curl& curl)
+{
+    const int code(curl.m_code);
+    if (!code) return;
+
+    curl_off_t start = 0;
+    curl_easy_getinfo(curl.m_curl, CURLINFO_STARTTRANSFER_TIME_T, &start);
+
+    queue.window.update(
+        code,
+        std::chrono::microseconds(start),
+        transfer.started,
+        m_adaptiveLatency);
+}
+
+// Pick the delay before retrying a transfer which got @p res.  Delays use
+// decorrelated jitter: each is drawn uniformly between the base delay and
+// triple the previous one, up to a cap, so that retries from many transfers
+// failing together spread out rather than firing in lockstep.  A delay
+// requested by the server is a lower bound.  Must be called with the lock
+// held.
+Pool::Clock::duration Pool::backoff(Transfer& transfer, const Response& res)
+{
+    using ms = std::chrono::milliseconds;
+
+    const ms prev(std::chrono::duration_cast<ms>(transfer.backoff));
+    Clock::duration delay(jitter(prev, retryBase, retryCap, m_rng));
+
+    delay = (std::max)(delay, Clock::duration(retryAfter(res)));
+
+    transfer.backoff = delay;
+    return delay;
+}
+
+// Give a no-longer-used Curl to the next pending transfer to be scheduled.
+// If none may run, return it to the free list.  Must be called with the lock
+// held.
+void Pool::hand(Curl& curl)
+{
+    if (Queue* queue = next())
+    {
+        bind(curl, pop(*queue));
+    }
+    else
+    {
+        curl.m_state = Curl::State::UNUSED;
+        m_free.emplace_back(&curl, Clock::now());
+        --shardOf(curl).busy;
+    }
+}
+
+// Get a handle for a new user, preferring a free one, then reopening a closed
+// one, then growing the pool.  Among free and closed handles, those of the
+// least busy shard win, and then the most recently used.  Returns null if the
+// pool is at capacity.  Must be called with the lock held.
+Curl* Pool::take()
+{
+    Curl* curl = nullptr;
+
+    auto busy = [this](Curl* c) { return shardOf(*c).busy; };
+
+    if (m_free.size())
+    {
+        auto best = std::prev(m_free.end());
+        if (m_shards.size() > 1)
+        {
+            for (auto it = best; it != m_free.begin(); )
+            {
+                --it;
+                if (busy(it->first) < busy(best->first)) best = it;
+            }
+        }
+        curl = best->first;
+        m_free.erase(best);
+    }
+    else if (m_cold.size())
+    {
+        // The easy handle is reopened when the next request is prepared.
+        auto best = std::prev(m_cold.end());
+        if (m_shards.size() > 1)
+        {
+            for (auto it = best; it != m_cold.begin(); )
+            {
+                --it;
+                if (busy(*it) < busy(*best)) best = it;
+            }
+        }
+        curl = *best;
+        m_cold.erase(best);
+        ++m_live;
+    }
+    else if (m_curls.size() < m_max)
+    {
+        // Grow the least busy shard, or the smallest among equally busy ones.
+        Shard& shard = **std::min_element(
+            m_shards.begin(),
+            m_shards.end(),
+            [](const std::unique_ptr<Shard>& a, const std::unique_ptr<Shard>& b)
+            {
+                return std::make_pair(a->busy, a->curls) <
+                    std::make_pair(b->busy, b->curls);
+            });
+
+        m_curls.push_back(std::make_unique<Curl>(m_curls.size(), m_config));
+        m_transfers.emplace_back();
+        curl = m_curls.back().get();
+        curl->m_shard = shard.index;
+        ++shard.curls;
+        ++m_live;
+    }
+
+    if (curl)
+        ++shardOf(*curl).busy;
+    return curl;
+}
+
+// Close the easy handles that have been idle too long, oldest first, keeping
+// at least the configured minimum open.
+void Pool::reap()
+{
+    std::lock_guard l(m_mutex);
+
+    const auto now = Clock::now();
+    while (m_free.size() && m_live > m_min &&
+        now - m_free.front().second >= m_idleTimeout)
+    {
+        Curl *curl = m_free.front().first;
+        m_free.pop_front();
+        curl->close();
+        m_cold.push_back(curl);
+        --m_live;
+    }
+}
+
+// Assign a submitted transfer to a Curl and queue it for its shard's runner,
+// which prepares it.  Must be called with the lock held.
+void Pool::bind(Curl& curl, Transfer transfer)
+{
+    curl.m_state = Curl::State::ACQUIRED;
+    ++transfer.queue->active;
+    ++m_active;
+    const bool high(transfer.req.priority == Priority::High);
+    m_transfers[curl.id()] = std::make_unique<Transfer>(std::move(transfer));
+
+    // High priority transfers are also first to be started by the runner.
+    Shard& shard(shardOf(curl));
+    if (high)
+        shard.ready.push_front(&curl);
+    else
+        shard.ready.push_back(&curl);
+    wakeup(shard);
+}
+
+// Wakeup all the run threads.
+void Pool::wakeup()
+{
+    for (auto& shard : m_shards)
+        wakeup(*shard);
+}
+
+// Wakeup the run thread of a shard.
+void Pool::wakeup(Shard& shard)
+{
+#ifdef __linux__
+    if (shard.wakeFd >= 0)
+    {
+        const std::uint64_t one = 1;
+        if (::write(shard.wakeFd, &one, sizeof(one)) < 0) { }
+        return;
+    }
+#endif
+    curl_multi_wakeup(shard.multi);
+}
+
+void Pool::submit(Request req, Callback cb)
+{
+    if (!m_max)
+        throw std::runtime_error("Cannot submit to empty pool");
+
+    const Cancellation cancel(req.cancel);
+    if (cancel)
+    {
+        if (cancel.cancelled())
+        {
+            cb(Response());
+            return;
+        }
+
+        // Have the runners look for transfers to stop once it fires.  A
+        // deadline is kept by curl, or by sweep for waiting transfers.
+        const std::size_t id(cancel.listen([this]()
+        {
+            std::lock_guard l(m_mutex);
+            for (auto& shard : m_shards)
+            {
+                shard->sweep = true;
+                wakeup(*shard);
+            }
+        }));
+
+        cb = [cancel, id, cb = std::move(cb)](Response res)
+        {
+            cancel.unlisten(id);
+            cb(std::move(res));
+        };
+    }
+
+    std::lock_guard l(m_mutex);
+    Transfer transfer;
+    transfer.req = std::move(req);
+    transfer.cb = std::move(cb);
+
+    if (m_coalesce && coalescable(transfer.req))
+    {
+        std::string key(flightKey(transfer.req));
+        auto& waiters(m_flights[key]);
+        waiters.push_back(std::move(transfer.cb));
+        if (waiters.size() > 1) return;
+
+        transfer.cb = [this, key](Response res) { land(key, std::move(res)); };
+    }
+
+    enqueue(std::move(transfer));
+    dispatch();
+
+    // Had it fired since listening, the runners may have looked before the
+    // transfer was there to find, so have them look again.
+    if (cancel.cancelled())
+    {
+        for (auto& shard : m_shards)
+        {
+            shard->sweep = true;
+            wakeup(*shard);
+        }
+    }
+}
+
+// Complete every request waiting on the coalesced transfer for @p key with a
+// copy of its response.  Requests made from here on start a new transfer.
+void Pool::land(const std::string& key, Response res)
+{
+    std::vector<Callback> waiters;
+    {
+        std::lock_guard l(m_mutex);
+        auto it = m_flights.find(key);
+        waiters = std::move(it->second);
+        m_flights.erase(it);
+    }
+
+    for (std::size_t i(0); i + 1 < waiters.size(); ++i)
+        waiters[i](res);
+    waiters.back()(std::move(res));
+}
+
+// Add a transfer to the back of its host's queue, creating the queue if the
+// host has nothing else outstanding.  Must be called with the lock held.
+void Pool::enqueue(Transfer transfer)
+{
+    if (!transfer.queue)
+    {
+        const std::string host(hostOf(transfer.req.path));
+        auto it = m_queues.find(host);
+        if (it == m_queues.end())
+        {
+            it = m_queues.emplace(host, Queue()).first;
+            Queue& queue(it->second);
+            queue.host = host;
+
+            const auto c = m_hostConfigs.find(host);
+            queue.config = c == m_hostConfigs.end() ? m_hostConfig : c->second;
+
+            queue.limits = Limits(queue.config);
+
+            if (m_adaptive)
+            {
+                queue.window.max = static_cast<double>(queue.config.concurrent
+                    ? (std::min)(queue.config.concurrent, m_max)
+                    : m_max);
+                queue.window.size = queue.window.max;
+            }
+        }
+
+        transfer.queue = &it->second;
+        ++transfer.queue->transfers;
+    }
+
+    // A queue which has been idle rejoins at the current pass, rather than
+    // making up for the time in which it had nothing to do.
+    Queue& queue(*transfer.queue);
+    if (!queue.level()) queue.pass = (std::max)(queue.pass, m_pass);
+    m_deadline = (std::min)(m_deadline, transfer.req.cancel.deadline());
+    const auto priority = static_cast<std::size_t>(transfer.req.priority);
+    queue.pending[priority].push_back(std::move(transfer));
+}
+
+// Bind pending transfers to Curls for as long as there are both.  Must be
+// called with the lock held.
+void Pool::dispatch()
+{
+    while (Queue* queue = next())
+    {
+        Curl* curl = take();
+        if (!curl) return;
+        bind(*curl, pop(*queue));
+    }
+}
+
+// The queue whose transfer should run next: of those with a pending transfer
+// within the limits of their host and of the pool, the one with the highest
+// priority waiting, and then the lowest pass.  Null if there is none.  Must
+// be called with the lock held.
+Pool::Queue* Pool::next()
+{
+    Queue* best = nullptr;
+    std::size_t bestLevel = 0;
+    const auto now = m_limited ? Clock::now() : Clock::time_point();
+    for (auto& p : m_queues)
+    {
+        Queue& queue(p.second);
+        if (queue.full()) continue;
+
+        const std::size_t level(queue.level());
+        if (!level || level < bestLevel) continue;
+
+        if (m_limited)
+        {
+            const Request& req(queue.pending[level - 1].front().req);
+            if (!admits(queue.limits, req, now) || !admits(m_limits, req, now))
+                continue;
+        }
+
+        if (!best || level > bestLevel || queue.pass < best->pass)
+        {
+            best = &queue;
+            bestLevel = level;
+        }
+    }
+    return best;
+}
+
+// Take the oldest pending transfer of the highest priority in @p queue,
+// charging the queue for its turn.  Must be called with the lock held.
+Pool::Transfer Pool::pop(Queue& queue)
+{
+    auto& pending(queue.pending[queue.level() - 1]);
+    Transfer transfer(std::move(pending.front()));
+    pending.pop_front();
+
+    m_pass = queue.pass;
+    queue.pass += 1.0 / queue.config.weight;
+
+    if (m_limited)
+    {
+        const double size(static_cast<double>(transfer.req.data.size()));
+        for (Limits* limits : { &queue.limits, &m_limits })
+        {
+            limits->requests.take(1);
+            limits->send.take(size);
+        }
+    }
+    return transfer;
+}
+
+// Whether @p req may start now as far as @p limits are concerned.  If not,
+// make sure a runner checks again once it may.  Must be called with the lock
+// held.
+bool Pool::admits(Limits& limits, const Request& req, const Clock::time_point now)
+{
+    const bool uploads(
+        req.verb == Request::Verb::PUT || req.verb == Request::Verb::POST);
+
+    Bucket& bytes(uploads ? limits.send : limits.recv);
+    for (Bucket* bucket : { &limits.requests, &bytes })
+    {
+        if (bucket->ready(now)) continue;
+
+        const auto at = bucket->readyAt();
+        if (at < m_rateWake)
+        {
+            m_rateWake = at;
+            wakeup(*m_shards.front());
+        }
+        return false;
+    }
+    return true;
+}
+
+// Hold a transfer about to run on @p curl to its share of the byte rates of
+// its host and of the pool.  Must be called with the lock held.
+void Pool::limit(Curl& curl, const Queue& queue)
+{
+    auto share([](const Bucket& b, std::size_t active)
+    {
+        return b.rate / static_cast<double>((std::max)(active, std::size_t(1)));
+    });
+    auto speed([&](const Bucket& host, const Bucket& pool)
+    {
+        double s = host.rate ? share(host, queue.active) : 0;
+        if (pool.rate)
+        {
+            const double p(share(pool, m_active));
+            s = s ? (std::min)(s, p) : p;
+        }
+        return static_cast<curl_off_t>(s ? (std::max)(s, 1.0) : 0);
+    });
+
+    curl_easy_setopt(
+        curl.m_curl,
+        CURLOPT_MAX_RECV_SPEED_LARGE,
+        speed(queue.limits.recv, m_limits.recv));
+    curl_easy_setopt(
+        curl.m_curl,
+        CURLOPT_MAX_SEND_SPEED_LARGE,
+        speed(queue.limits.send, m_limits.send));
+}
+
+void ConcurrencyWindow::update(
+        const int code,
+        const std::chrono::microseconds latency,
+        const Clock::time_point started,
+        const double threshold)
+{
+    using us = std::chrono::microseconds;
+
+    bool congested = code == 429 || code == 503;
+
+    if (!congested && latency.count() > 0)
+    {
+        if (!best.count() || latency < best) best = latency;
+        if (!nextBest.count() || latency < nextBest) nextBest = latency;
+
+        // Let the baseline drift upward if the host has gotten slower.
+        if (++samples % 256 == 0)
+        {
+            best = nextBest;
+            nextBest = us::zero();
+        }
+
+        congested = threshold > 0 && latency.count() > threshold * best.count();
+    }
+
+    if (congested)
+    {
+        if (started >= shrunk)
+        {
+            size = (std::max)(1.0, std::floor(size / 2));
+            shrunk = Clock::now();
+        }
+    }
+    else
+    {
+        size = (std::min)(max, size + 1 / size);
+    }
+}
+
+bool TokenBucket::ready(const Clock::time_point now)
+{
+    if (!rate) return true;
+
+    const std::chrono::duration<double> elapsed(now - updated);
+    tokens = (std::min)(rate, tokens + rate * elapsed.count());
+    updated = now;
+    return tokens >= least();
+}
+
+TokenBucket::Clock::time_point TokenBucket::readyAt() const
+{
+    if (!rate || tokens >= least()) return updated;
+
+    // Just past the point where the debt is paid off and a token is back.
+    const std::chrono::duration<double> wait(
+            (least() - tokens) / rate + 0.001);
+    return updated + std::chrono::duration_cast<Clock::duration>(wait);
+}
+
+std::future<Response> Pool::submit(Request req)
+{
+    auto promise = std::make_shared<std::promise<Response>>();
+    std::future<Response> future = promise->get_future();
+    submit(std::move(req), [promise](Response res)
+    {
+        promise->set_value(std::move(res));
+    });
+    return future;
+}
+
+void Pool::recycle(std::vector<char> buffer)
+{
+    std::lock_guard l(m_mutex);
+    stash(std::move(buffer));
+}
+
+// Keep a buffer for reuse if it fits within the cache.  Must be called with
+// the lock held.
+void Pool::stash(std::vector<char> buffer)
+{
+    const std::size_t capacity(buffer.capacity());
+    if (!capacity || m_bufferBytes + capacity > m_bufferCache) return;
+
+    m_bufferBytes += capacity;
+    m_buffers.emplace(capacity, std::move(buffer));
+}
+
+// Take the smallest cached buffer with room for @p reserve bytes, if any.
+// Must be called with the lock held.
+std::vector<char> Pool::unstash(const std::size_t reserve)
+{
+    auto it = m_buffers.lower_bound(reserve);
+    if (it == m_buffers.end()) return std::vector<char>();
+
+    std::vector<char> buffer(std::move(it->second));
+    m_bufferBytes -= it->first;
+    m_buffers.erase(it);
+    return buffer;
+}
+
+// Get a Resource for making blocking requests.  Resources do not hold a Curl,
+// so this does not wait.
+Resource Pool::acquire()
+{
+    return acquire(PriorityScope::current());
+}
+
+Resource Pool::acquire(const Priority priority)
+{
+    if (!m_max)
+        throw std::runtime_error("Cannot acquire from empty pool");
+
+    return Resource(*this, priority, CancellationScope::current());
 }
 
 } // namepace http
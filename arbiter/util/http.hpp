@@ -1,12 +1,16 @@
 #pragma once
 
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <string>
 #include <thread>
 #include <vector>
@@ -38,15 +42,168 @@ ARBITER_DLL std::string sanitize(const std::string& path, const std::string& exc
  */
 ARBITER_DLL std::string buildQueryString(const http::Query& query);
 
+/** A Sink which writes to the file descriptor @p fd. */
+ARBITER_DLL Sink fdSink(int fd);
+
+/** A Sink which fills the @p size bytes at @p data, failing if there is more
+ * than that.
+ */
+ARBITER_DLL Sink bufferSink(char* data, std::size_t size);
+
+/** Sets the priority of the HTTP requests made from the current thread for
+ * as long as it exists, restoring the previous one on destruction.  Requests
+ * default to Priority::Normal.  This lets a priority reach the requests that
+ * drivers make on behalf of a call, such as signed S3 requests:
+ *
+ * @code
+ * {
+ *     http::PriorityScope scope(http::Priority::High);
+ *     data = a.getBinary("s3://bucket/tile.laz");
+ * }
+ * @endcode
+ */
+class ARBITER_DLL PriorityScope
+{
+public:
+    /** If @p priority is empty, the current priority is left as it is. */
+    explicit PriorityScope(std::optional<Priority> priority);
+    ~PriorityScope();
+
+    PriorityScope(const PriorityScope&) = delete;
+    PriorityScope& operator=(const PriorityScope&) = delete;
+
+    /** The priority of requests made from the current thread. */
+    static Priority current();
+
+private:
+    Priority m_prev;
+};
+
+/** Attaches a Cancellation to the HTTP requests made from the current thread
+ * for as long as it exists, restoring the previous one on destruction.  Like
+ * PriorityScope, this reaches the requests that drivers make on behalf of a
+ * call:
+ *
+ * @code
+ * {
+ *     http::CancellationScope scope(
+ *         http::Cancellation::after(std::chrono::seconds(2)));
+ *     data = a.getBinary("s3://bucket/tile.laz");
+ * }
+ * @endcode
+ */
+class ARBITER_DLL CancellationScope
+{
+public:
+    explicit CancellationScope(Cancellation cancel);
+    ~CancellationScope();
+
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+    /** The Cancellation of requests made from the current thread. */
+    static Cancellation current();
+
+private:
+    Cancellation m_prev;
+};
+
 /** @cond arbiter_internal */
 
+// The delay requested by a server before retrying, from an Azure
+// `x-ms-retry-after-ms` header or a `Retry-After` header in either seconds
+// or HTTP-date form.  Zero if there is none.
+ARBITER_DLL std::chrono::milliseconds retryAfter(const Response& res);
+
+// The retry delay to follow one of @p prev, by decorrelated jitter: drawn
+// uniformly between @p base and triple the greater of @p prev and @p base,
+// and at most @p cap.
+ARBITER_DLL std::chrono::milliseconds jitter(
+        std::chrono::milliseconds prev,
+        std::chrono::milliseconds base,
+        std::chrono::milliseconds cap,
+        std::mt19937_64& rng);
+
+// The lowercased host, with any port, that a request URL is for.  URLs may
+// omit the scheme, in which case curl assumes one.
+ARBITER_DLL std::string hostOf(const std::string& url);
+
+// Identifies the requests which a coalescable GET or HEAD may share a
+// transfer with: the same verb, URL, query, priority, retry and timeout, and
+// the same headers apart from those which only date or sign the request.
+ARBITER_DLL std::string flightKey(const Request& req);
+
+// A token bucket refilled at a rate per second, holding up to one second's
+// worth.  Something may be taken once a whole token is there (or the whole
+// bucket, below a rate of one).  Takes may overdraw it, and nothing more may
+// be taken until the debt is paid back.  A rate of zero is unlimited.
+struct ARBITER_DLL TokenBucket
+{
+    using Clock = std::chrono::steady_clock;
+
+    explicit TokenBucket(double rate = 0) : rate(rate), tokens(rate) { }
+
+    // Refill for the time since the last update, and whether there is
+    // anything to take.
+    bool ready(Clock::time_point now);
+
+    // When ready will next be true, as of the last update.
+    Clock::time_point readyAt() const;
+
+    void take(double n) { if (rate) tokens -= n; }
+
+    // The tokens needed before anything may be taken.
+    double least() const { return (std::min)(1.0, rate); }
+
+    double rate;
+    double tokens;
+    Clock::time_point updated = Clock::now();
+};
+
+// The adaptive concurrency limit of a host.  The window halves, down to one
+// transfer, when the host signals congestion, but only once for the
+// transfers started before the previous shrink.  Otherwise it grows by one
+// per window's worth of transfers, up to its largest size.
+struct ARBITER_DLL ConcurrencyWindow
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Resize following a response with status @p code to a transfer
+    // started at @p started, whose first byte took @p latency, or zero if
+    // unknown.  A 429 or 503 is congestion, as is a latency over
+    // @p threshold times the best recent one, if @p threshold is positive.
+    void update(
+            int code,
+            std::chrono::microseconds latency,
+            Clock::time_point started,
+            double threshold);
+
+    // The current and largest window, or zero if not adaptive.
+    double size = 0;
+    double max = 0;
+    // The best time to first byte recently, and so far in the current run
+    // of samples, which will replace it.
+    std::chrono::microseconds best = std::chrono::microseconds::zero();
+    std::chrono::microseconds nextBest = std::chrono::microseconds::zero();
+    std::size_t samples = 0;
+    // When the window last shrank.  Transfers started earlier than this do
+    // not shrink it again.
+    Clock::time_point shrunk;
+};
+
 class ARBITER_DLL Pool;
 
+/** Blocking access to a Pool.  Each request is submitted to the Pool and
+ * waited on, so no Curl is held between requests or between the retries of
+ * one request.
+ */
 class ARBITER_DLL Resource
 {
 public:
-    Resource(Pool& pool, Curl& curl, std::size_t retry);
-    ~Resource();
+    Resource(
+            Pool& pool,
+            Priority priority = Priority::Normal,
+            Cancellation cancel = Cancellation());
 
     http::Response get(
             std::string path,
@@ -56,6 +213,18 @@ public:
             int retry = -1,
             std::size_t timeout = 0);
 
+    /** Like get, but a successful body is handed to @p sink as it arrives
+     * instead of being held in the response.  The request is not retried
+     * once any of the body has been delivered.
+     */
+    http::Response get(
+            std::string path,
+            Sink sink,
+            Headers headers = Headers(),
+            Query query = Query(),
+            int retry = -1,
+            std::size_t timeout = 0);
+
     http::Response head(
             std::string path,
             Headers headers = Headers(),
@@ -75,49 +244,389 @@ public:
             Headers headers = Headers(),
             Query query = Query());
 
+    http::Response del(
+            std::string path,
+            Headers headers = Headers(),
+            Query query = Query());
+
 private:
     Pool& m_pool;
-    Curl& m_curl;
-    std::size_t m_retry;
+    Priority m_priority;
+    Cancellation m_cancel;
 
-    http::Response exec(std::function<http::Response()> f, int retry = -1);
+    http::Response exec(Request req);
 };
 
 class ARBITER_DLL Pool
 {
-    // Only HttpResource may release.
-    friend class Resource;
-
 public:
+    using Callback = std::function<void(Response)>;
+
     Pool() : Pool(4, 4, "") { }
+
+    /** Create a pool of up to @p concurrent Curl handles.  Handles are
+     * created as demand requires, and those idle for longer than the
+     * `http.idleTimeout` configuration value (in seconds, 60 by default) are
+     * closed until only `http.minConcurrent` (4 by default) remain open.
+     *
+     * The runner thread services transfers with `curl_multi_perform` and
+     * `curl_multi_poll` by default.  Setting `http.runner` (or the
+     * `ARBITER_HTTP_RUNNER` environment variable) to `"epoll"` instead drives
+     * them with `curl_multi_socket_action` from an epoll loop, so only sockets
+     * with activity are serviced.  The epoll runner is Linux-only, elsewhere
+     * the poll runner is always used.
+     *
+     * Setting `http.shards` (or `ARBITER_HTTP_SHARDS`) to N splits the
+     * handles among N runner threads, each with its own multi handle, to
+     * spread transfer processing over multiple cores.  New requests go to the
+     * least busy shard.  There is a single shard by default.
+     *
+     * Up to `http.bufferCache` bytes (64 MiB by default, or
+     * `ARBITER_HTTP_BUFFER_CACHE`) of response buffers handed back with
+     * Pool::recycle are kept for reuse by later GET responses whose bodies
+     * fit in them.  Drivers hand back the buffers they read into and then
+     * discard, like those of string reads and copies.  Zero disables this.
+     *
+     * Setting `http.http2` (or `ARBITER_HTTP2=1`) negotiates HTTP/2 for TLS
+     * connections, with a fallback to HTTP/1.1.  Concurrent transfers to the
+     * same host are multiplexed over a shared connection.  Each shard keeps
+     * its own connections, so multiplexing works best with fewer shards.
+     * Setting `http.h2c` (or `ARBITER_H2C=1`) does the same, and also speaks
+     * HTTP/2 over plain-text connections without negotiating it first, for
+     * servers known to support that, given libcurl 8 or later.  Otherwise
+     * the protocol is left to the defaults of libcurl.
+     *
+     * Transfers waiting for a handle are queued per host, and the queues
+     * take turns at free handles so that a backlog for one host does not
+     * hold up the others.  `http.hostConcurrent` (or
+     * `ARBITER_HTTP_HOST_CONCURRENT`) caps the transfers running against any
+     * one host, which is unlimited by default.  Individual hosts may be
+     * configured under `http.hosts`, keyed by host name (with the port, if
+     * it appears in the URL), with a `concurrent` cap of their own and a
+     * `weight` (1 by default) giving their share of the handles relative to
+     * other busy hosts:
+     *
+     * @code
+     * { "http": { "hosts": { "tiles.example.com": { "weight": 4 } } } }
+     * @endcode
+     *
+     * Across hosts, transfers of a higher Priority always get a free handle
+     * ahead of those of a lower one.
+     *
+     * Setting `http.adaptive` (or `ARBITER_HTTP_ADAPTIVE=1`) also limits
+     * each host to a window of concurrent transfers, which grows by one for
+     * each window's worth of successes and halves when the host is
+     * congested.  A 429 or 503 response means the host is congested, and so
+     * does a time to first byte more than `http.adaptiveLatency` (4 by
+     * default, or 0 to ignore latency) times the host's recent best.  The
+     * window starts out at the host's limit, or the size of the pool.
+     *
+     * Rates may be capped by `http.requestsPerSecond`,
+     * `http.recvBytesPerSecond` and `http.sendBytesPerSecond` for the pool as
+     * a whole (or `ARBITER_HTTP_REQUESTS_PER_SECOND`,
+     * `ARBITER_HTTP_RECV_BYTES_PER_SECOND` and
+     * `ARBITER_HTTP_SEND_BYTES_PER_SECOND`), and by the same keys within an
+     * `http.hosts` entry for a single host.  Each is a token bucket holding
+     * up to a second's worth, so short bursts are allowed.  A transfer waits
+     * while a bucket it draws on is empty.  Running transfers are held to
+     * their share of a byte rate with curl's speed limits, and bytes beyond
+     * it are paid back before later transfers start.
+     *
+     * Setting `http.hedge` (or `ARBITER_HTTP_HEDGE`) to a percentile, such
+     * as 95, hedges GET and HEAD requests without a Sink: one which has not
+     * received its first byte within that percentile of the recent times to
+     * first byte of the pool is issued again on another handle, if one is
+     * free and the rate limits have a request to spare.  Whichever attempt
+     * finishes first is kept and the other is cancelled.
+     *
+     * Setting `http.coalesce` (or `ARBITER_HTTP_COALESCE=1`) lets a GET or
+     * HEAD request without a Sink share the transfer of an identical one
+     * which is already outstanding, see flightKey.  Requests signed moments
+     * apart are identical, as long as they ask for the same thing.  Each of
+     * them completes with a copy of the response.
+     */
     Pool(std::size_t concurrent, std::size_t retry, const std::string& config);
     ~Pool();
 
+    /** Get a Resource whose requests have the priority and Cancellation of
+     * the calling thread, see PriorityScope and CancellationScope.
+     */
     Resource acquire();
+    Resource acquire(Priority priority);
     void wakeup();
-    void perform(Curl& curl);
+
+    /** The most transfers that run at once. */
+    std::size_t concurrent() const { return m_max; }
+
+    /** Queue @p req for execution and return immediately.  Once the
+     * transfer completes, including any retries, @p cb is invoked with the
+     * response from a runner thread.  The callback must be brief and must
+     * not block on this Pool.  Transfers still outstanding when the Pool is
+     * destroyed complete with a response code of zero.
+     *
+     * Server errors, 429 responses, and transient transport failures are
+     * retried up to the retry count of @p req, or of the Pool if that is
+     * negative.  Retries wait out a randomized backoff without holding a
+     * Curl, and never less than a `Retry-After` or `x-ms-retry-after-ms`
+     * response header asks.  A transport failure completes with a response
+     * code of zero.  A POST is only retried after one which may have left
+     * the request with the server if @p req is marked idempotent.
+     *
+     * If the Cancellation of @p req fires, the transfer is stopped, or
+     * dropped if it is waiting, and completes with a response code of zero.
+     *
+     * Throws, like acquire, if the Pool has no handles to run it on.
+     */
+    void submit(Request req, Callback cb);
+
+    /** Queue @p req for execution, returning a future for the response. */
+    std::future<Response> submit(Request req);
+
+    /** Hand back a response body which is no longer needed, so that the
+     * storage can be reused by a later GET response instead of allocating.
+     */
+    void recycle(std::vector<char> buffer);
 
 private:
-    void run();
-    void release(Curl& curl);
-    int handleReady();
-    bool handleFailure();
-    bool handleCompleted();
-
-    CURL *m_multi;
-    std::vector<Curl> m_curls;
-    std::thread m_runner;
+    using Clock = std::chrono::steady_clock;
+
+    struct Queue;
+    struct Transfer;
+
+    // The attempts running a hedged request, of which the first to finish is
+    // kept.
+    struct Race
+    {
+        bool done = false;
+        std::vector<Curl*> curls;
+    };
+
+    // A queued request along with its completion handler and retry state.
+    struct Transfer
+    {
+        Request req;
+        Callback cb;
+        // Shared with a hedged duplicate, if there is one.
+        std::shared_ptr<Race> race;
+        // The queue of the request's host, which outlives the transfer.
+        Queue* queue = nullptr;
+        std::size_t tries = 0;
+        // The previous retry delay, from which the next one is drawn.
+        Clock::duration backoff = Clock::duration::zero();
+        // When the latest attempt was started by a runner.
+        Clock::time_point started;
+    };
+
+    // A runner thread with its own multi handle, which performs the
+    // transfers of the Curls assigned to it.
+    struct Shard
+    {
+        std::size_t index = 0;
+        CURLM* multi = nullptr;
+        std::thread runner;
+
+        // Handles to be added to the multi handle by the runner, guarded by
+        // the Pool mutex along with the counts.
+        std::deque<Curl*> ready;
+        int running = 0;
+        // Handles owned by this shard, and how many of them are in use.
+        std::size_t curls = 0;
+        std::size_t busy = 0;
+        // Running transfers to hedge if they have no response by then, and
+        // those which lost a race, to be stopped by the runner.
+        // The former are identified by the Curl and the start of the attempt.
+        std::multimap<
+            Clock::time_point,
+            std::pair<Curl*, Clock::time_point>> hedges;
+        std::vector<std::pair<Curl*, std::shared_ptr<Race>>> cancels;
+        // Whether a Cancellation has fired since the runner last looked for
+        // transfers to stop.
+        bool sweep = false;
+
+        // Epoll runner state, unused by the poll runner.  Everything but the
+        // descriptors is only touched from the runner thread.
+        int epoll = -1;
+        int wakeFd = -1;
+        bool timerSet = false;
+        Clock::time_point timer;
+    };
+
+    // Scheduling settings for a host.
+    struct HostConfig
+    {
+        // Maximum transfers running at once, or zero for no limit.
+        std::size_t concurrent = 0;
+        double weight = 1;
+        // Rate limits, or zero for none.
+        double requestsPerSecond = 0;
+        double recvBytesPerSecond = 0;
+        double sendBytesPerSecond = 0;
+    };
+
+    using Bucket = TokenBucket;
+
+    // The rate limits of a host, or of the whole pool.
+    struct Limits
+    {
+        Limits() = default;
+        explicit Limits(const HostConfig& c)
+            : requests(c.requestsPerSecond)
+            , recv(c.recvBytesPerSecond)
+            , send(c.sendBytesPerSecond)
+        { }
+
+        bool any() const { return requests.rate || recv.rate || send.rate; }
+
+        Bucket requests;
+        Bucket recv;
+        Bucket send;
+    };
+
+    static constexpr std::size_t priorities = 3;
+
+    // The adaptive concurrency limit of a host, see Pool::adapt.
+    using Window = ConcurrencyWindow;
+
+    // The transfers to one host, which share the handles with other hosts
+    // by start-time fair queuing: of the busy queues with the highest
+    // priority waiting, the one with the lowest pass goes next, after which
+    // its pass advances by the inverse of its weight.
+    struct Queue
+    {
+        std::string host;
+        HostConfig config;
+        // Transfers waiting for a Curl, in arrival order, by priority.
+        std::deque<Transfer> pending[priorities];
+        // Transfers bound to a Curl.
+        std::size_t active = 0;
+        // All outstanding transfers, including those waiting out a retry.
+        std::size_t transfers = 0;
+        double pass = 0;
+        Window window;
+        Limits limits;
+
+        // Whether no more transfers may run until some finish.
+        bool full() const
+        {
+            const std::size_t cap = window.size
+                ? static_cast<std::size_t>(window.size)
+                : config.concurrent;
+            return cap && active >= cap;
+        }
+
+        // One more than the highest priority with a transfer waiting, or
+        // zero if nothing is waiting.
+        std::size_t level() const
+        {
+            std::size_t n(priorities);
+            while (n && pending[n - 1].empty()) --n;
+            return n;
+        }
+    };
+
+    using Completions = std::vector<std::pair<Callback, Response>>;
+
+    void run(Shard& shard);
+    void runEvents(Shard& shard);
+    int handleReady(Shard& shard);
+    void handleFailure(Shard& shard);
+    void handleCompleted(Shard& shard);
+    void finish(Curl& curl, CURLcode result, Completions& completions);
+    Clock::duration backoff(Transfer& transfer, const Response& res);
+    void adapt(Queue& queue, const Transfer& transfer, Curl& curl);
+    bool admits(Limits& limits, const Request& req, Clock::time_point now);
+    void limit(Curl& curl, const Queue& queue);
+    void hand(Curl& curl);
+    void enqueue(Transfer transfer);
+    void dispatch();
+    Queue* next();
+    Transfer pop(Queue& queue);
+    void bind(Curl& curl, Transfer transfer);
+    Curl* take();
+    void reap();
+    int pollTimeout(Shard& shard, int maxMs);
+    void hedge(Shard& shard, Completions& completions);
+    void sweep(Shard& shard, Completions& completions);
+    void abort(Shard& shard, Curl& curl, Completions& completions);
+    void retire(Queue& queue);
+    bool race(Curl& curl, Transfer& transfer, bool ok);
+    void settle(Race& race);
+    void sample(Curl& curl);
+    void land(const std::string& key, Response res);
+    void wakeup(Shard& shard);
+    void close(Shard& shard);
+    void stash(std::vector<char> buffer);
+    std::vector<char> unstash(std::size_t reserve);
+    Shard& shardOf(const Curl& curl) { return *m_shards[curl.m_shard]; }
+
+    static int onSocket(
+            CURL* easy,
+            curl_socket_t s,
+            int what,
+            void* shard,
+            void* known);
+    static int onTimer(CURLM* multi, long ms, void* shard);
+
+    std::vector<std::unique_ptr<Curl>> m_curls;
+    std::vector<std::unique_ptr<Shard>> m_shards;
     std::size_t m_retry;
+    const std::string m_config;
+    const std::size_t m_max;
+    std::size_t m_min = 4;
+    std::chrono::seconds m_idleTimeout = std::chrono::seconds(60);
     // The explicit initialization is necessary on Linux for C++17.
     // See the "Note" here: https://en.cppreference.com/cpp/atomic/atomic/atomic
     std::atomic<bool> m_stop = false;
 
     std::mutex m_mutex;
-    // Provide notification between a thread waiting on a Curl and one
-    // making one available.
-    std::condition_variable m_cv;
-    // Provide notification between the run thread and those waiting.
-    std::condition_variable m_poolCv;
+    // Handles not in use by anyone, with the time they were released, most
+    // recent last.  Only non-empty when no pending transfer is under its
+    // host's limit.
+    std::deque<std::pair<Curl*, Clock::time_point>> m_free;
+    // Handles whose easy handle has been closed after sitting idle.
+    std::vector<Curl*> m_cold;
+    // Handles with an open easy handle.
+    std::size_t m_live = 0;
+    // Jitter for retry delays.
+    std::mt19937_64 m_rng;
+    // Recycled response buffers keyed by capacity, and their total capacity.
+    std::multimap<std::size_t, std::vector<char>> m_buffers;
+    std::size_t m_bufferBytes = 0;
+    std::size_t m_bufferCache = 64 * 1024 * 1024;
+    // Submitted transfers, indexed by the ID of the Curl running them.
+    std::vector<std::unique_ptr<Transfer>> m_transfers;
+    // Per-host scheduling settings, and the defaults for other hosts.
+    std::map<std::string, HostConfig> m_hostConfigs;
+    HostConfig m_hostConfig;
+    // Queues of the hosts with outstanding transfers, and the pass of the
+    // most recently scheduled one.
+    std::map<std::string, Queue> m_queues;
+    double m_pass = 0;
+    bool m_adaptive = false;
+    double m_adaptiveLatency = 4;
+    // Rate limits of the pool as a whole, whether any limits are set for the
+    // pool or any host, and when a transfer held back by a rate limit may
+    // next be able to go.
+    Limits m_limits;
+    bool m_limited = false;
+    Clock::time_point m_rateWake = Clock::time_point::max();
+    // Transfers bound to a Curl.
+    std::size_t m_active = 0;
+    // The hedging percentile, or zero if requests are not hedged, the recent
+    // times to first byte, the next of which to replace, and the delay they
+    // give for hedging.
+    double m_hedge = 0;
+    std::vector<std::chrono::microseconds> m_latencies;
+    std::size_t m_latency = 0;
+    Clock::duration m_hedgeDelay = Clock::duration::zero();
+    // Whether identical requests share a transfer, and the completion
+    // handlers of those doing so, keyed by flightKey.
+    bool m_coalesce = false;
+    std::map<std::string, std::vector<Callback>> m_flights;
+    // The earliest deadline of a transfer waiting for a Curl.
+    Clock::time_point m_deadline = Clock::time_point::max();
+    // Submitted transfers waiting out their retry backoff.
+    std::multimap<Clock::time_point, Transfer> m_delayed;
 };
 
 /** @endcond */
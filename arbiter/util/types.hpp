@@ -1,9 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
@@ -30,18 +41,180 @@ using Headers = std::map<std::string, std::string>;
 /** HTTP query parameters. */
 using Query = std::map<std::string, std::string>;
 
-/** @cond arbiter_internal */
+/** Receives a response body in pieces as it arrives.  Returning false stops
+ * the transfer.
+ */
+using Sink = std::function<bool(const char* data, std::size_t size)>;
 
-class PutData
+/** The order in which waiting requests get a connection.  Requests of a
+ * higher priority always go first, and those of equal priority take turns by
+ * host.
+ */
+enum class Priority
+{
+    Low,
+    Normal,
+    High
+};
+
+/** Gives up on the requests it is attached to, either at a deadline or when
+ * cancelled from another thread, after which they complete with a response
+ * code of zero.  Running transfers are stopped and waiting ones are dropped,
+ * and no retry is started which could not begin before the deadline.  Copies
+ * share their state.  A default-constructed Cancellation never fires.
+ */
+class Cancellation
 {
 public:
-    void init(const std::vector<char>& data)
+    using Clock = std::chrono::steady_clock;
+
+    Cancellation() = default;
+
+    /** A Cancellation with no deadline, which fires only when cancelled. */
+    static Cancellation create() { return at(Clock::time_point::max()); }
+
+    /** A Cancellation which fires at @p deadline, or when cancelled. */
+    static Cancellation at(Clock::time_point deadline)
     {
-        m_data = data;
-        m_offset = 0;
+        Cancellation c;
+        c.m_state = std::make_shared<State>();
+        c.m_state->deadline = deadline;
+        return c;
+    }
+
+    /** A Cancellation which fires after @p timeout, or when cancelled. */
+    static Cancellation after(Clock::duration timeout)
+    {
+        return at(Clock::now() + timeout);
+    }
+
+    explicit operator bool() const { return !!m_state; }
+
+    /** Give up on the requests now, whatever the deadline. */
+    void cancel() const
+    {
+        if (!m_state) return;
+        std::lock_guard<std::mutex> l(m_state->mutex);
+        if (m_state->cancelled.exchange(true)) return;
+        for (auto& p : m_state->listeners) p.second();
+    }
+
+    /** Whether this has been cancelled or its deadline has passed. */
+    bool cancelled() const
+    {
+        return m_state &&
+            (m_state->cancelled || Clock::now() >= m_state->deadline);
+    }
+
+    Clock::time_point deadline() const
+    {
+        return m_state ? m_state->deadline : Clock::time_point::max();
+    }
+
+    /** @cond arbiter_internal */
+
+    // Have @p f called, with an internal lock held, upon cancel.  Returns an
+    // ID with which to stop listening.
+    std::size_t listen(std::function<void()> f) const
+    {
+        std::lock_guard<std::mutex> l(m_state->mutex);
+        m_state->listeners.emplace(m_state->next, std::move(f));
+        return m_state->next++;
+    }
+
+    void unlisten(std::size_t id) const
+    {
+        std::lock_guard<std::mutex> l(m_state->mutex);
+        m_state->listeners.erase(id);
     }
 
-    void init(std::vector<char>&& data)
+    /** @endcond */
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::atomic<bool> cancelled = false;
+        Clock::time_point deadline;
+        std::size_t next = 0;
+        std::map<std::size_t, std::function<void()>> listeners;
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+/** @cond arbiter_internal */
+
+/** A read-only view of a request body, which is never copied.  The bytes are
+ * either owned by the caller, who must keep them alive until the transfer
+ * completes, or shared with the Body, which keeps them alive itself.
+ */
+class Body
+{
+public:
+    Body() = default;
+
+    /** Take ownership of @p data. */
+    Body(std::vector<char> data)
+        : Body(std::make_shared<const std::vector<char>>(std::move(data)))
+    { }
+
+    /** Share ownership of @p data, which must not be modified. */
+    Body(std::shared_ptr<const std::vector<char>> data)
+        : m_owner(data)
+        , m_data(data ? data->data() : nullptr)
+        , m_size(data ? data->size() : 0)
+    { }
+
+    /** Reference caller-owned memory. */
+    Body(const char* data, std::size_t size)
+        : m_data(data)
+        , m_size(size)
+    { }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    std::shared_ptr<const void> m_owner;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+/** A self-contained description of a single HTTP transfer, which may be
+ * queued for asynchronous execution with Pool::submit.
+ */
+struct Request
+{
+    enum class Verb
+    {
+        GET,
+        HEAD,
+        PUT,
+        POST,
+        DEL     // DELETE, which is a macro on Windows.
+    };
+
+    Verb verb = Verb::GET;
+    std::string path;
+    Headers headers;
+    Query query;
+    Body data;                  // Request body for PUT and POST.
+    std::size_t reserve = 0;
+    Sink sink;                  // Receives a successful GET body if set.
+    int retry = -1;             // Use the Pool's default if negative.
+    std::size_t timeout = 0;
+    Priority priority = Priority::Normal;
+    Cancellation cancel;
+    // Whether a POST may be sent again after a transport failure, by which
+    // time it may already have reached the server.  Other verbs always may.
+    bool idempotent = false;
+};
+
+class PutData
+{
+public:
+    void init(Body data)
     {
         m_data = std::move(data);
         m_offset = 0;
@@ -61,29 +234,198 @@ private:
         size_t remaining = m_data.size() - m_offset;
         size_t extractCount = (std::min)(size, remaining);
 
-        std::memcpy(out, m_data.data() + m_offset, extractCount);
+        if (extractCount)
+            std::memcpy(out, m_data.data() + m_offset, extractCount);
         m_offset += extractCount;
         return extractCount;
     }
 
-    std::vector<char> m_data;
+    Body m_data;
     size_t m_offset = 0;
 };
 
+/** Response headers, stored flat in one buffer in the order received rather
+ * than as a map of separately allocated strings.  Names are matched
+ * case-insensitively, by way of a case-folded hash of each header kept in a
+ * sorted index, so that a lookup is a binary search which rarely compares
+ * any characters.
+ */
+class ResponseHeaders
+{
+public:
+    void clear()
+    {
+        m_arena.clear();
+        m_entries.clear();
+        m_index.clear();
+    }
+
+    // Add a header, trimming whitespace from around its value.
+    void add(std::string_view name, std::string_view value)
+    {
+        while (value.size() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        while (value.size() && (value.back() == ' ' || value.back() == '\t'))
+            value.remove_suffix(1);
+
+        if (m_entries.empty())
+        {
+            m_arena.reserve(1024);
+            m_entries.reserve(16);
+            m_index.reserve(16);
+        }
+
+        Entry e;
+        e.hash = hash(name);
+        e.name = static_cast<std::uint32_t>(m_arena.size());
+        e.nameSize = static_cast<std::uint32_t>(name.size());
+        m_arena.append(name);
+        e.value = static_cast<std::uint32_t>(m_arena.size());
+        e.valueSize = static_cast<std::uint32_t>(value.size());
+        m_arena.append(value);
+
+        // After any others with the same hash, so that the first of any
+        // repeated headers is found first.
+        const Slot slot(e.hash, static_cast<std::uint32_t>(m_entries.size()));
+        m_index.insert(
+            std::upper_bound(m_index.begin(), m_index.end(), slot, byHash),
+            slot);
+        m_entries.push_back(e);
+    }
+
+    // The value of the first header named @p name, if there is one.  The
+    // result refers into this object.
+    std::optional<std::string_view> find(std::string_view name) const
+    {
+        const Slot slot(hash(name), 0);
+        auto it(std::lower_bound(m_index.begin(), m_index.end(), slot, byHash));
+        for ( ; it != m_index.end() && it->first == slot.first; ++it)
+        {
+            const Entry& e(m_entries[it->second]);
+            if (iequals(nameOf(e), name)) return valueOf(e);
+        }
+        return std::nullopt;
+    }
+
+    std::size_t size() const { return m_entries.size(); }
+
+    // Copy out to a map.  The first of any repeated headers wins.
+    Headers map() const
+    {
+        Headers headers;
+        for (const Entry& e : m_entries)
+        {
+            headers.emplace(nameOf(e), valueOf(e));
+        }
+        return headers;
+    }
+
+    static bool iequals(std::string_view a, std::string_view b)
+    {
+        return a.size() == b.size() &&
+            std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+            {
+                return fold(x) == fold(y);
+            });
+    }
+
+private:
+    struct Entry
+    {
+        std::uint32_t hash;
+        std::uint32_t name;
+        std::uint32_t nameSize;
+        std::uint32_t value;
+        std::uint32_t valueSize;
+    };
+
+    // The hash of a header and its position in m_entries.
+    using Slot = std::pair<std::uint32_t, std::uint32_t>;
+
+    static bool byHash(const Slot& a, const Slot& b)
+    {
+        return a.first < b.first;
+    }
+
+    static char fold(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // FNV-1a over the case-folded name.
+    static std::uint32_t hash(std::string_view s)
+    {
+        std::uint32_t h(2166136261u);
+        for (const char c : s)
+        {
+            h ^= static_cast<unsigned char>(fold(c));
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    std::string_view nameOf(const Entry& e) const
+    {
+        return std::string_view(m_arena.data() + e.name, e.nameSize);
+    }
+
+    std::string_view valueOf(const Entry& e) const
+    {
+        return std::string_view(m_arena.data() + e.value, e.valueSize);
+    }
+
+    std::string m_arena;
+    std::vector<Entry> m_entries;
+    std::vector<Slot> m_index;
+};
+
 class Response
 {
 public:
+    // Prepare for a response with a body, which is sized up front once its
+    // length is known from the response headers.
     void init(std::size_t reserve)
     {
         m_data.reserve(reserve);
         init();
+        m_presize = true;
+    }
+
+    // Prepare for a response whose body, if successful, goes to @p sink
+    // rather than being held.  Error bodies are still held.
+    void init(Sink sink)
+    {
+        init();
+        m_sink = std::move(sink);
     }
 
     void init()
     {
         m_code = 0;
+        m_status = 0;
+        m_delivered = 0;
         m_data.clear();
         m_headers.clear();
+        m_sink = Sink();
+        m_source = Source();
+        m_presize = false;
+    }
+
+    // Supplies storage for a body of a given length, which may be recycled
+    // from an earlier response.
+    using Source = std::function<std::vector<char>(std::size_t size)>;
+
+    // Use the storage of @p buffer for the body.
+    void useBuffer(std::vector<char> buffer)
+    {
+        m_data = std::move(buffer);
+        m_data.clear();
+    }
+
+    // Ask @p source for storage once the length of the body is known.
+    void useSource(Source source)
+    {
+        m_source = std::move(source);
     }
 
     bool ok() const             { return m_code / 100 == 2; }
@@ -92,9 +434,18 @@ public:
     int code() const            { return m_code; }
     void setCode(long code)     { m_code = code; }
 
+    // The number of body bytes handed to a sink.
+    std::size_t delivered() const { return m_delivered; }
+
     // We move data out of the response, so only call once.
     std::vector<char>&& data() { return std::move(m_data); }
-    Headers headers() { return std::move(m_headers); }
+    Headers headers() const { return m_headers.map(); }
+    // Case-insensitive lookup of a single header, which is cheaper than
+    // copying them all out with headers().
+    std::optional<std::string_view> header(std::string_view name) const
+    {
+        return m_headers.find(name);
+    }
     std::string str()
     {
         std::string s(m_data.data(), m_data.size());
@@ -108,6 +459,15 @@ public:
         Response& response = *static_cast<Response *>(cbData);
 
         size *= num;  // Size is really size * num.
+
+        if (response.m_sink && response.m_status / 100 == 2)
+        {
+            // Anything other than the full size aborts the transfer.
+            if (!response.m_sink(in, size)) return 0;
+            response.m_delivered += size;
+            return size;
+        }
+
         response.append(in, size);
         return size;
     }
@@ -124,9 +484,53 @@ public:
 private:
     void append(const char *in, size_t size)
     {
-        std::size_t startSize = m_data.size();
-        m_data.resize(startSize + size);
-        std::memcpy(m_data.data() + startSize, in, size);
+        m_data.insert(m_data.end(), in, in + size);
+    }
+
+    // Reserve room for the whole body from a Content-Length or Content-Range
+    // header, so that it isn't reallocated as it arrives.
+    void presize(std::string_view key, std::string_view val)
+    {
+        auto is([key](std::string_view name)
+        {
+            return ResponseHeaders::iequals(key, name);
+        });
+
+        unsigned long long size = 0;
+
+        if (is("Content-Length"))
+        {
+            const std::string v(val);
+            size = std::strtoull(v.c_str(), nullptr, 10);
+        }
+        else if (is("Content-Range"))
+        {
+            const std::string v(val);
+
+            // Of the form "bytes <first>-<last>/<total>".
+            const std::size_t dash = v.find('-');
+            const std::size_t space = v.find(' ');
+            if (dash == std::string::npos || space == std::string::npos) return;
+
+            const auto first = std::strtoull(v.c_str() + space + 1, nullptr, 10);
+            const auto last = std::strtoull(v.c_str() + dash + 1, nullptr, 10);
+            if (last >= first) size = last - first + 1;
+        }
+
+        if (size <= m_data.capacity()) return;
+
+        // An absurd length should not take down the transfer, which can still
+        // grow its buffer as data actually arrives.
+        try
+        {
+            if (m_source && m_data.empty())
+            {
+                std::vector<char> buffer(m_source(size));
+                if (buffer.capacity() >= size) useBuffer(std::move(buffer));
+            }
+            if (size > m_data.capacity()) m_data.reserve(size);
+        }
+        catch (...) { }
     }
 
     void addHeaders(const char *in, size_t size)
@@ -150,6 +554,18 @@ private:
 
         std::string_view data(in, size);
 
+        // The status line of each response, including interim and redirect
+        // ones, of the form "HTTP/1.1 200 OK".
+        if (data.substr(0, 5) == "HTTP/")
+        {
+            const std::size_t space(data.find(' '));
+            if (space != std::string::npos)
+            {
+                m_status = std::atoi(std::string(data.substr(space + 1)).c_str());
+            }
+            return;
+        }
+
         const std::size_t split(data.find_first_of(":"));
 
         // No colon means it isn't a header with data.
@@ -157,13 +573,20 @@ private:
         {
             std::string_view key(data.substr(0, split));
             std::string_view val(data.substr(split + 1));
-            m_headers.emplace(key, val);
+            m_headers.add(key, val);
+
+            if (m_presize) presize(key, val);
         }
     }
 
     long m_code;
     std::vector<char> m_data;
-    Headers m_headers;
+    ResponseHeaders m_headers;
+    bool m_presize = false;
+    int m_status = 0;
+    Sink m_sink;
+    Source m_source;
+    std::size_t m_delivered = 0;
 };
 
 /** @endcond */
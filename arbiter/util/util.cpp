@@ -2,13 +2,18 @@
 #include <arbiter/util/util.hpp>
 
 #include <arbiter/arbiter.hpp>
+#include <arbiter/util/http.hpp>
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <deque>
+#include <exception>
 #include <mutex>
 #include <random>
 #include <string>
+#include <thread>
 
 #ifdef ARBITER_CUSTOM_NAMESPACE
 namespace ARBITER_CUSTOM_NAMESPACE
@@ -29,6 +34,20 @@ namespace
     std::mt19937 gen(rd());
     std::uniform_int_distribution<unsigned long long> distribution;
 
+    // Threads taken from the shared limit, see acquireThreads.
+    std::mutex threadMutex;
+    std::size_t threadsTaken(0);
+
+    std::size_t threadLimit()
+    {
+        static const std::size_t limit([]() -> std::size_t
+        {
+            if (auto v = env("ARBITER_THREADS")) return std::stoul(*v);
+            return (std::max)(1u, std::thread::hardware_concurrency()) * 4;
+        }());
+        return limit;
+    }
+
     bool iequals(const std::string& s, const std::string& s2)
     {
         if (s.length() != s2.length())
@@ -55,6 +74,103 @@ std::unique_ptr<std::string> findHeader(
     return std::unique_ptr<std::string>();
 }
 
+namespace internal
+{
+
+void parallelFor(
+        const std::size_t n,
+        const std::size_t threads,
+        const std::function<void(std::size_t)>& f)
+{
+    const http::Priority priority(http::PriorityScope::current());
+    const http::Cancellation cancel(http::CancellationScope::current());
+
+    std::atomic<std::size_t> next(0);
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    auto work([&]()
+    {
+        const http::PriorityScope priorityScope(priority);
+        const http::CancellationScope cancelScope(cancel);
+
+        std::size_t i;
+        while ((i = next++) < n)
+        {
+            try
+            {
+                f(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+                next = n;
+            }
+        }
+    });
+
+    std::vector<std::thread> pool;
+    const std::size_t count((std::min)(n, threads));
+    const std::size_t extra(count > 1 ? acquireThreads(count - 1) : 0);
+    for (std::size_t i(0); i < extra; ++i) pool.emplace_back(work);
+    work();
+    for (auto& t : pool) t.join();
+    releaseThreads(extra);
+
+    if (error) std::rethrow_exception(error);
+}
+
+std::size_t acquireThreads(const std::size_t n)
+{
+    std::lock_guard<std::mutex> lock(threadMutex);
+    const std::size_t taken((std::min)(n, threadLimit() - threadsTaken));
+    threadsTaken += taken;
+    return taken;
+}
+
+void releaseThreads(const std::size_t n)
+{
+    std::lock_guard<std::mutex> lock(threadMutex);
+    threadsTaken -= n;
+}
+
+void windowed(
+        const std::size_t n,
+        const std::size_t window,
+        const std::function<std::future<std::vector<char>>(std::size_t)>& start,
+        const std::function<void(
+            std::size_t,
+            std::future<std::vector<char>>&)>& finish)
+{
+    std::deque<std::pair<std::size_t, std::future<std::vector<char>>>> reads;
+    auto next([&]()
+    {
+        finish(reads.front().first, reads.front().second);
+        reads.pop_front();
+    });
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        if (reads.size() >= (std::max)(window, std::size_t(1))) next();
+
+        try
+        {
+            reads.emplace_back(i, start(i));
+        }
+        catch (...)
+        {
+            std::promise<std::vector<char>> failed;
+            failed.set_exception(std::current_exception());
+            reads.emplace_back(i, failed.get_future());
+        }
+    }
+
+    while (reads.size()) next();
+}
+
+} // namespace internal
+
 uint64_t randomNumber()
 {
     std::lock_guard<std::mutex> lock(randomMutex);
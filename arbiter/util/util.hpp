@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
 #include <utility>
@@ -199,6 +201,39 @@ std::unique_ptr<T> maybeClone(const T* t)
     else return std::unique_ptr<T>();
 }
 
+/** Call @p f with each index in [0, @p n) from up to @p threads threads,
+ * including the calling one, each with the http::PriorityScope and
+ * http::CancellationScope of the caller.  Threads beyond the calling one
+ * are taken from the shared limit of acquireThreads, so there may be fewer.
+ * If @p f throws, no more indices are started and the first exception is
+ * rethrown once all threads finish.
+ */
+ARBITER_DLL void parallelFor(
+        std::size_t n,
+        std::size_t threads,
+        const std::function<void(std::size_t)>& f);
+
+/** Take up to @p n threads from a limit shared by the whole process, for
+ * work started beside its caller, and return how many were taken.  Give
+ * them back with releaseThreads once they finish.  The limit is
+ * `ARBITER_THREADS`, or four per hardware thread by default.
+ */
+ARBITER_DLL std::size_t acquireThreads(std::size_t n);
+ARBITER_DLL void releaseThreads(std::size_t n);
+
+/** Call @p start with each index in [0, @p n) in order, to start reading
+ * it, while no more than @p window of the reads are outstanding.  Each
+ * read, or the exception with which it failed to start, is handed to
+ * @p finish in the same order once the window moves past it.
+ */
+ARBITER_DLL void windowed(
+        std::size_t n,
+        std::size_t window,
+        const std::function<std::future<std::vector<char>>(std::size_t)>& start,
+        const std::function<void(
+            std::size_t,
+            std::future<std::vector<char>>&)>& finish);
+
 } // namespace internal
 
 ARBITER_DLL uint64_t randomNumber();
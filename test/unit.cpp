@@ -1,10 +1,30 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <future>
+#include <mutex>
 #include <numeric>
+#include <random>
 #include <set>
+#include <sstream>
+#include <thread>
 
 #include <arbiter/util/time.hpp>
 #include <arbiter/arbiter.hpp>
 #include <arbiter/util/transforms.hpp>
 
+#ifndef ARBITER_WINDOWS
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <curl/curl.h>
+
 #include "config.hpp"
 
 #include "gtest/gtest.h"
@@ -71,41 +91,1842 @@ TEST(Arbiter, Base64)
     EXPECT_EQ(crypto::decodeBase64("Zm9vYmFy"), "foobar");
 }
 
-class DriverTest : public ::testing::TestWithParam<std::string> { };
+TEST(Arbiter, ResponsePresize)
+{
+    const std::string length("Content-Length: 12345\r\n");
+    const std::string range("content-range: bytes 100-40099/50000\r\n");
 
-TEST_P(DriverTest, PutGet)
+    http::Response get;
+    get.init(0);
+    http::Response::headerCb(length.data(), 1, length.size(), &get);
+    EXPECT_GE(get.data().capacity(), 12345u);
+
+    get.init(0);
+    http::Response::headerCb(range.data(), 1, range.size(), &get);
+    EXPECT_GE(get.data().capacity(), 40000u);
+
+    // Bodiless responses are not presized.
+    http::Response head;
+    head.init();
+    http::Response::headerCb(length.data(), 1, length.size(), &head);
+    EXPECT_EQ(head.data().capacity(), 0u);
+}
+
+TEST(Arbiter, ResponseSource)
 {
-    Arbiter a;
+    const std::string length("Content-Length: 1000\r\n");
 
-    const std::string root(GetParam());
-    const std::string path(root + "test.txt");
-    const std::string data("Testing path " + path);
+    std::vector<char> recycled;
+    recycled.reserve(4096);
+    const char* storage(recycled.data());
 
-    if (a.isLocal(root)) mkdirp(root);
+    std::size_t asked(0);
+    http::Response res;
+    res.init(0);
+    res.useSource([&](std::size_t size)
+    {
+        asked = size;
+        return std::move(recycled);
+    });
+    http::Response::headerCb(length.data(), 1, length.size(), &res);
+    EXPECT_EQ(asked, 1000u);
+    EXPECT_EQ(res.data().data(), storage);
 
-    EXPECT_NO_THROW(a.put(path, data));
-    EXPECT_EQ(a.get(path), data);
+    // Storage which is too small is not used.
+    std::vector<char> small;
+    small.reserve(10);
+    res.init(0);
+    res.useSource([&](std::size_t) { return std::move(small); });
+    http::Response::headerCb(length.data(), 1, length.size(), &res);
+    EXPECT_GE(res.data().capacity(), 1000u);
 }
 
-TEST_P(DriverTest, HttpRange)
+TEST(Arbiter, ResponseHeaders)
 {
-    Arbiter a;
+    http::Response res;
+    res.init();
+    for (const std::string line : {
+            "HTTP/1.1 200 OK\r\n",
+            "Content-Length:  42 \r\n",
+            "ETag: \"abc\"\r\n",
+            "dropbox-api-result: {\"size\": 42}\r\n" })
+    {
+        http::Response::headerCb(line.data(), 1, line.size(), &res);
+    }
 
-    const std::string root(GetParam());
-    const std::string path(root + "range.txt");
-    const std::string data("0123456789");
+    ASSERT_TRUE(res.header("content-length"));
+    EXPECT_EQ(*res.header("content-length"), "42");
+    EXPECT_EQ(*res.header("ETAG"), "\"abc\"");
+    EXPECT_EQ(*res.header("Dropbox-API-Result"), "{\"size\": 42}");
+    EXPECT_FALSE(res.header("Content-Range"));
 
-    const std::size_t x(2);
-    const std::size_t y(8);
-    const http::Headers headers{
-        // The range header is inclusive of the end, so subtract 1 here.
-        { "Range", "bytes=" + std::to_string(x) + "-" + std::to_string(y - 1) }
+    const http::Headers headers(res.headers());
+    EXPECT_EQ(headers.size(), 3u);
+    EXPECT_EQ(headers.at("Content-Length"), "42");
+
+    // The first of any repeated headers wins, among many others.
+    http::ResponseHeaders many;
+    for (int i(0); i < 100; ++i)
+    {
+        many.add("X-Header-" + std::to_string(i), std::to_string(i));
+    }
+    many.add("x-header-7", "repeated");
+    EXPECT_EQ(many.size(), 101u);
+    for (int i(0); i < 100; ++i)
+    {
+        const auto v(many.find("x-HEADER-" + std::to_string(i)));
+        ASSERT_TRUE(v);
+        EXPECT_EQ(*v, std::to_string(i));
+    }
+    EXPECT_FALSE(many.find("X-Header-100"));
+
+    many.clear();
+    EXPECT_FALSE(many.find("X-Header-0"));
+}
+
+TEST(Arbiter, RetryAfter)
+{
+    using ms = std::chrono::milliseconds;
+
+    auto after([](std::string line)
+    {
+        line += "\r\n";
+        http::Response res;
+        res.init();
+        http::Response::headerCb(line.data(), 1, line.size(), &res);
+        return http::retryAfter(res);
+    });
+
+    EXPECT_EQ(after("Retry-After: 120"), std::chrono::seconds(120));
+    EXPECT_EQ(after("x-ms-retry-after-ms: 1500"), ms(1500));
+
+    // Dates in the past ask for no delay.
+    EXPECT_EQ(after("Retry-After: Wed, 21 Oct 2015 07:28:00 GMT"), ms(0));
+    EXPECT_GT(
+        after("Retry-After: Fri, 01 Jan 2100 00:00:00 GMT"),
+        std::chrono::hours(24 * 365));
+
+    EXPECT_EQ(after("Retry-After: soon"), ms(0));
+    EXPECT_EQ(after("Content-Length: 10"), ms(0));
+}
+
+TEST(Arbiter, RetryJitter)
+{
+    using ms = std::chrono::milliseconds;
+    const ms base(500);
+    const ms cap(60000);
+
+    std::mt19937_64 rng(42);
+    ms prev(0);
+    ms longest(0);
+    for (int i(0); i < 1000; ++i)
+    {
+        const ms next(http::jitter(prev, base, cap, rng));
+        EXPECT_GE(next, base);
+        EXPECT_LE(next, (std::min)(cap, (std::max)(prev, base) * 3));
+        longest = (std::max)(longest, next);
+        prev = next;
+    }
+
+    // Delays grow from the base towards the cap.
+    EXPECT_GT(longest, cap / 2);
+}
+
+TEST(Arbiter, PutBody)
+{
+    const std::vector<char> data { 'a', 'b', 'c', 'd', 'e', 'f', 'g' };
+
+    // Bodies view the caller's memory, or share their own, without copying.
+    const http::Body borrowed(data.data(), data.size());
+    EXPECT_EQ(borrowed.data(), data.data());
+
+    auto shared(std::make_shared<const std::vector<char>>(data));
+    const http::Body owner(shared);
+    EXPECT_EQ(owner.data(), shared->data());
+    EXPECT_EQ(owner.size(), data.size());
+
+    // The upload callback hands the body out in pieces, then nothing.
+    http::PutData put;
+    put.init(owner);
+
+    std::vector<char> sent;
+    char out[3];
+    std::size_t n(0);
+    while ((n = http::PutData::putCb(out, 1, sizeof(out), &put)))
+    {
+        EXPECT_LE(n, sizeof(out));
+        sent.insert(sent.end(), out, out + n);
+    }
+    EXPECT_EQ(sent, data);
+    EXPECT_EQ(http::PutData::putCb(out, 1, sizeof(out), &put), 0u);
+}
+
+TEST(Arbiter, Sinks)
+{
+    const std::string a("abc");
+    const std::string b("defg");
+
+    std::vector<char> buffer(7);
+    auto fill(http::bufferSink(buffer.data(), buffer.size()));
+    EXPECT_TRUE(fill(a.data(), a.size()));
+    EXPECT_TRUE(fill(b.data(), b.size()));
+    EXPECT_EQ(std::string(buffer.data(), buffer.size()), "abcdefg");
+
+    // Anything past the end of the buffer fails the transfer.
+    EXPECT_FALSE(fill(a.data(), 1));
+
+    std::vector<char> small(5);
+    auto overflow(http::bufferSink(small.data(), small.size()));
+    EXPECT_TRUE(overflow(a.data(), a.size()));
+    EXPECT_FALSE(overflow(b.data(), b.size()));
+
+#ifndef ARBITER_WINDOWS
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    auto pipe(http::fdSink(fds[1]));
+    EXPECT_TRUE(pipe(a.data(), a.size()));
+    EXPECT_TRUE(pipe(b.data(), b.size()));
+    ::close(fds[1]);
+
+    char got[16];
+    std::string read;
+    ssize_t n(0);
+    while ((n = ::read(fds[0], got, sizeof(got))) > 0) read.append(got, n);
+    EXPECT_EQ(read, "abcdefg");
+
+    // Writes to a closed descriptor fail the transfer.
+    EXPECT_FALSE(pipe(a.data(), a.size()));
+    ::close(fds[0]);
+#endif
+}
+
+TEST(Arbiter, HostOf)
+{
+    EXPECT_EQ(http::hostOf("https://Bucket.S3.amazonaws.com/a/b.laz"),
+            "bucket.s3.amazonaws.com");
+    EXPECT_EQ(http::hostOf("http://localhost:8080?x=1"), "localhost:8080");
+    EXPECT_EQ(http::hostOf("http://user:pw@example.com/path"), "example.com");
+    EXPECT_EQ(http::hostOf("example.com/a@b"), "example.com");
+    EXPECT_EQ(http::hostOf("example.com#top"), "example.com");
+    EXPECT_EQ(http::hostOf("http://[::1]:9000/"), "[::1]:9000");
+}
+
+TEST(Arbiter, PriorityScope)
+{
+    EXPECT_EQ(http::PriorityScope::current(), http::Priority::Normal);
+    {
+        http::PriorityScope outer(http::Priority::Low);
+        EXPECT_EQ(http::PriorityScope::current(), http::Priority::Low);
+        {
+            http::PriorityScope inner(http::Priority::High);
+            EXPECT_EQ(http::PriorityScope::current(), http::Priority::High);
+        }
+        {
+            http::PriorityScope unset(std::nullopt);
+            EXPECT_EQ(http::PriorityScope::current(), http::Priority::Low);
+        }
+        EXPECT_EQ(http::PriorityScope::current(), http::Priority::Low);
+    }
+    EXPECT_EQ(http::PriorityScope::current(), http::Priority::Normal);
+}
+
+namespace
+{
+    // Nothing listens here, so requests fail at once without the network.
+    const std::string refused("http://127.0.0.1:1/nothing");
+
+    // Submit @p reqs at once and wait for all of their responses.
+    std::vector<http::Response> getAll(
+            http::Pool& pool,
+            const std::vector<http::Request>& reqs)
+    {
+        std::vector<std::future<http::Response>> futures;
+        for (const auto& req : reqs) futures.push_back(pool.submit(req));
+
+        std::vector<http::Response> responses;
+        for (auto& f : futures)
+        {
+            if (f.wait_for(std::chrono::seconds(10)) == std::future_status::ready)
+            {
+                responses.push_back(f.get());
+            }
+            else
+            {
+                ADD_FAILURE() << "Request did not complete";
+                responses.emplace_back();
+            }
+        }
+        return responses;
+    }
+
+    // GETs of @p url with the target of each numbered from zero, so that
+    // TestServer::echo tells them apart.
+    std::vector<http::Request> numbered(const std::string& url, std::size_t n)
+    {
+        std::vector<http::Request> reqs(n);
+        for (std::size_t i(0); i < n; ++i)
+        {
+            reqs[i].path = url + std::to_string(i);
+            reqs[i].retry = 0;
+        }
+        return reqs;
+    }
+
+    std::string body(http::Response& res)
+    {
+        const std::vector<char> data(res.data());
+        return std::string(data.begin(), data.end());
+    }
+
+#ifndef ARBITER_WINDOWS
+    // A request received by a TestServer.
+    struct Seen
+    {
+        std::string method;
+        // The path and query.
+        std::string target;
+        std::string version;
+        // Keyed by lowercased name.
+        http::Headers headers;
+        std::string body;
+        // The connection it arrived on, numbered from one.
+        std::size_t connection = 0;
+        std::chrono::steady_clock::time_point at;
     };
 
-    if (!a.isHttpDerived(root)) return;
+    // What a TestServer answers a request with, after a delay.  A hangup
+    // drops the connection instead.
+    struct Reply
+    {
+        int code = 200;
+        http::Headers headers;
+        std::string body;
+        std::chrono::milliseconds delay = std::chrono::milliseconds(0);
+        bool hangup = false;
+    };
 
-    EXPECT_NO_THROW(a.put(path, data));
-    EXPECT_EQ(a.get(path, headers), data.substr(x, y - x));
+    // A local HTTP/1.1 server on a free port, which answers each request
+    // with the Reply of its handler, and records the requests, the
+    // connections they came on, and the most it was answering at once.
+    // Connections opening with the HTTP/2 preface are answered in HTTP/2.
+    class TestServer
+    {
+    public:
+        using Handler = std::function<Reply(const Seen&)>;
+
+        explicit TestServer(Handler handler = echo)
+            : m_handler(handler)
+            , m_listen(::socket(AF_INET, SOCK_STREAM, 0))
+        {
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t size(sizeof(addr));
+
+            if (m_listen < 0 ||
+                ::bind(m_listen, (sockaddr*)&addr, size) != 0 ||
+                ::listen(m_listen, 64) != 0 ||
+                ::getsockname(m_listen, (sockaddr*)&addr, &size) != 0)
+            {
+                throw std::runtime_error("Could not start the test server");
+            }
+
+            m_port = ntohs(addr.sin_port);
+            m_accepter = std::thread([this]() { accept(); });
+        }
+
+        ~TestServer()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+                for (const int fd : m_open) ::shutdown(fd, SHUT_RDWR);
+            }
+            m_cv.notify_all();
+
+            ::shutdown(m_listen, SHUT_RDWR);
+            m_accepter.join();
+            ::close(m_listen);
+            for (auto& t : m_connections) t.join();
+        }
+
+        // Answers with the request target.
+        static Reply echo(const Seen& seen)
+        {
+            Reply reply;
+            reply.body = seen.target;
+            return reply;
+        }
+
+        std::string url(const std::string& target = "/") const
+        {
+            return "http://127.0.0.1:" + std::to_string(m_port) + target;
+        }
+
+        std::string host() const
+        {
+            return "127.0.0.1:" + std::to_string(m_port);
+        }
+
+        int port() const { return m_port; }
+
+        std::vector<Seen> requests() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_seen;
+        }
+
+        std::size_t connections() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_connections.size();
+        }
+
+        std::size_t peak() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_peak;
+        }
+
+    private:
+        void accept()
+        {
+            while (true)
+            {
+                const int fd(::accept(m_listen, nullptr, nullptr));
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_stop)
+                {
+                    if (fd >= 0) ::close(fd);
+                    return;
+                }
+                if (fd < 0) continue;
+
+                m_open.insert(fd);
+                const std::size_t id(m_connections.size() + 1);
+                m_connections.emplace_back([this, fd, id]() { serve(fd, id); });
+            }
+        }
+
+        void serve(const int fd, const std::size_t id)
+        {
+            std::string in;
+            while (in.size() < preface.size() && receive(fd, in)) { }
+
+            if (in.compare(0, preface.size(), preface) == 0)
+            {
+                in.erase(0, preface.size());
+                serveHttp2(fd, id, in);
+            }
+            else while (read(fd, id, in)) { }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_open.erase(fd);
+            ::close(fd);
+        }
+
+        // Answer the next request on @p fd, returning false once the
+        // connection is done with.
+        bool read(const int fd, const std::size_t id, std::string& in)
+        {
+            std::size_t end;
+            while ((end = in.find("\r\n\r\n")) == std::string::npos)
+            {
+                if (!receive(fd, in)) return false;
+            }
+
+            Seen seen;
+            seen.connection = id;
+            seen.at = std::chrono::steady_clock::now();
+
+            std::istringstream head(in.substr(0, end));
+            in.erase(0, end + 4);
+
+            std::string line;
+            std::getline(head, line);
+            std::istringstream(line) >> seen.method >> seen.target >> seen.version;
+            while (std::getline(head, line))
+            {
+                const std::size_t colon(line.find(':'));
+                if (colon == std::string::npos) continue;
+
+                std::string name(line.substr(0, colon));
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                std::string value(line.substr(colon + 1));
+                value.erase(0, value.find_first_not_of(' '));
+                value.erase(value.find_last_not_of("\r ") + 1);
+                seen.headers[name] = value;
+            }
+
+            if (seen.headers.count("expect") &&
+                !send(fd, "HTTP/1.1 100 Continue\r\n\r\n"))
+            {
+                return false;
+            }
+
+            const auto length(seen.headers.find("content-length"));
+            const std::size_t size(
+                length == seen.headers.end() ? 0 : std::stoul(length->second));
+            while (in.size() < size)
+            {
+                if (!receive(fd, in)) return false;
+            }
+            seen.body = in.substr(0, size);
+            in.erase(0, size);
+
+            const Reply reply(m_handler(seen));
+            if (!hold(seen, reply)) return false;
+
+            std::string out(
+                "HTTP/1.1 " + std::to_string(reply.code) + " Test\r\n" +
+                "Content-Length: " + std::to_string(reply.body.size()) +
+                "\r\n");
+            for (const auto& h : reply.headers)
+            {
+                out += h.first + ": " + h.second + "\r\n";
+            }
+            out += "\r\n";
+            if (seen.method != "HEAD") out += reply.body;
+            return send(fd, out);
+        }
+
+        // Speak just enough HTTP/2 to answer requests sent with prior
+        // knowledge, each stream on its own thread.  Request headers are
+        // not decoded, so only the connection and the time of each request
+        // are seen.
+        void serveHttp2(const int fd, const std::size_t id, std::string& in)
+        {
+            const auto frame = [](
+                    int type, int flags, uint32_t stream, std::string payload)
+            {
+                const std::size_t size(payload.size());
+                return std::string{
+                    char(size >> 16), char(size >> 8), char(size),
+                    char(type), char(flags),
+                    char(stream >> 24), char(stream >> 16), char(stream >> 8),
+                    char(stream) } + payload;
+            };
+
+            std::mutex sending;
+            const auto write = [&](const std::string& out)
+            {
+                std::lock_guard<std::mutex> lock(sending);
+                return send(fd, out);
+            };
+
+            std::vector<std::thread> streams;
+            bool open(write(frame(4, 0, 0, "")));   // Our SETTINGS.
+
+            while (open)
+            {
+                std::size_t size(0);
+                while (open &&
+                    (in.size() < 9 ||
+                    in.size() < 9 + (size =
+                        (uint8_t)in[0] << 16 | (uint8_t)in[1] << 8 |
+                        (uint8_t)in[2])))
+                {
+                    open = receive(fd, in);
+                }
+                if (!open) break;
+
+                const int type(in[3]);
+                const int flags(in[4]);
+                const uint32_t stream(
+                    ((uint8_t)in[5] & 0x7f) << 24 | (uint8_t)in[6] << 16 |
+                    (uint8_t)in[7] << 8 | (uint8_t)in[8]);
+                const std::string payload(in.substr(9, size));
+                in.erase(0, 9 + size);
+
+                const bool ack(flags & 0x1);
+                const bool ended(flags & 0x1);
+
+                if (type == 4 && !ack) open = write(frame(4, 0x1, 0, ""));
+                else if (type == 6 && !ack)
+                {
+                    open = write(frame(6, 0x1, 0, payload));
+                }
+                else if (type == 7) open = false;   // GOAWAY.
+                else if ((type == 0 || type == 1) && ended)
+                {
+                    Seen seen;
+                    seen.version = "HTTP/2";
+                    seen.connection = id;
+                    seen.at = std::chrono::steady_clock::now();
+                    const Reply reply(m_handler(seen));
+
+                    streams.emplace_back([&, seen, reply, stream]()
+                    {
+                        if (!hold(seen, reply))
+                        {
+                            if (reply.hangup) ::shutdown(fd, SHUT_RDWR);
+                            return;
+                        }
+
+                        // :status as a literal with an indexed name, which
+                        // is all the HPACK we need to write.
+                        const std::string code(std::to_string(reply.code));
+                        write(
+                            frame(1, 0x4, stream,
+                                std::string{ 0x08, char(code.size()) } + code) +
+                            frame(0, 0x1, stream, reply.body));
+                    });
+                }
+            }
+
+            for (auto& t : streams) t.join();
+        }
+
+        // Record @p seen and wait out the delay of its @p reply, returning
+        // false if the connection should be dropped instead of answering.
+        bool hold(const Seen& seen, const Reply& reply)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_seen.push_back(seen);
+            m_peak = (std::max)(m_peak, ++m_busy);
+            m_cv.wait_for(lock, reply.delay, [this]() { return m_stop; });
+            --m_busy;
+            return !m_stop && !reply.hangup;
+        }
+
+        static bool receive(const int fd, std::string& in)
+        {
+            char data[65536];
+            const ssize_t n(::recv(fd, data, sizeof(data), 0));
+            if (n <= 0) return false;
+            in.append(data, n);
+            return true;
+        }
+
+        static bool send(const int fd, const std::string& out)
+        {
+            std::size_t sent(0);
+            while (sent < out.size())
+            {
+                const ssize_t n(::send(
+                    fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL));
+                if (n <= 0) return false;
+                sent += n;
+            }
+            return true;
+        }
+
+        const std::string preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        const Handler m_handler;
+        const int m_listen;
+        int m_port = 0;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stop = false;
+        std::set<int> m_open;
+        std::vector<Seen> m_seen;
+        std::size_t m_busy = 0;
+        std::size_t m_peak = 0;
+
+        std::thread m_accepter;
+        std::vector<std::thread> m_connections;
+    };
+
+    // A TestServer handler which echoes after a delay of @p ms.
+    TestServer::Handler slowly(int ms)
+    {
+        return [ms](const Seen& seen)
+        {
+            Reply reply(TestServer::echo(seen));
+            reply.delay = std::chrono::milliseconds(ms);
+            return reply;
+        };
+    }
+#endif
+}
+
+TEST(Arbiter, PoolSubmit)
+{
+    http::Pool pool(2, 0, "");
+
+    http::Request req;
+    req.path = refused;
+    req.retry = 0;
+
+    // A transport failure completes with a code of zero.
+    std::promise<int> code;
+    pool.submit(req, [&code](http::Response res)
+    {
+        code.set_value(res.code());
+    });
+    EXPECT_EQ(code.get_future().get(), 0);
+
+    EXPECT_EQ(pool.submit(req).get().code(), 0);
+    EXPECT_EQ(pool.acquire().get(refused, {}, {}, 0, 0).code(), 0);
+
+    // More transfers than handles each complete once.
+    std::atomic<int> done(0);
+    std::vector<std::future<http::Response>> futures;
+    for (int i(0); i < 20; ++i)
+    {
+        pool.submit(req, [&done](http::Response) { ++done; });
+        futures.push_back(pool.submit(req));
+    }
+    for (auto& f : futures) EXPECT_EQ(f.get().code(), 0);
+
+    const auto start(std::chrono::steady_clock::now());
+    while (done < 20 &&
+        std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(done, 20);
+}
+
+TEST(Arbiter, RetryTransport)
+{
+#ifndef ARBITER_WINDOWS
+    // Drops every connection without answering.
+    TestServer server([](const Seen&)
+    {
+        Reply reply;
+        reply.hangup = true;
+        return reply;
+    });
+
+    http::Pool pool(4, 0, "");
+    const std::vector<char> data { 'a', 'b', 'c' };
+
+    auto request([&](std::string target, http::Request::Verb verb)
+    {
+        http::Request req;
+        req.verb = verb;
+        req.path = server.url(target);
+        req.retry = 1;
+        if (verb == http::Request::Verb::POST) req.data = http::Body(data);
+        return req;
+    });
+
+    // A POST which may have reached the server is only sent again if it's
+    // marked idempotent.  Other verbs always are.
+    auto post(request("/post", http::Request::Verb::POST));
+    auto idempotent(request("/idempotent", http::Request::Verb::POST));
+    idempotent.idempotent = true;
+    auto get(request("/get", http::Request::Verb::GET));
+    auto put(request("/put", http::Request::Verb::PUT));
+
+    for (auto& res : getAll(pool, { post, idempotent, get, put }))
+    {
+        EXPECT_EQ(res.code(), 0);
+    }
+
+    std::map<std::string, int> tries;
+    for (const auto& seen : server.requests()) ++tries[seen.target];
+    EXPECT_EQ(tries["/post"], 1);
+    EXPECT_EQ(tries["/idempotent"], 2);
+    EXPECT_EQ(tries["/get"], 2);
+    EXPECT_EQ(tries["/put"], 2);
+#endif
+}
+
+TEST(Arbiter, HttpRangeIgnored)
+{
+#ifndef ARBITER_WINDOWS
+    auto str([](const std::vector<char>& v) { return std::string(v.begin(), v.end()); });
+
+    // A server which ignores the Range header sends the whole file with a
+    // 200, which is sliced here, even if it's no longer than the range.
+    // Partial responses are taken as they are.
+    TestServer server([](const Seen& seen)
+    {
+        Reply reply;
+        if (seen.target == "/whole") reply.body = "0123456789";
+        else
+        {
+            if (seen.target == "/partial") reply.code = 206;
+            reply.headers["Content-Range"] = "bytes 2-5/10";
+            reply.body = "2345";
+        }
+        return reply;
+    });
+
+    http::Pool pool;
+    drivers::Http http(pool);
+    const std::string whole(server.host() + "/whole");
+    EXPECT_EQ(str(http.getRange(whole, 2, 100)), "23456789");
+    EXPECT_EQ(server.requests().back().headers.at("range"), "bytes=2-101");
+    EXPECT_EQ(str(http.getRange(whole, 2, 3)), "234");
+    EXPECT_EQ(str(http.getRange(whole, 0, 10)), "0123456789");
+    EXPECT_FALSE(http.tryGetRange(whole, 10, 1));
+
+    EXPECT_EQ(str(http.getRange(server.host() + "/partial", 2, 4)), "2345");
+    EXPECT_EQ(str(http.getRange(server.host() + "/ranged", 2, 4)), "2345");
+#endif
+}
+
+TEST(Arbiter, GetRanges)
+{
+#ifndef ARBITER_WINDOWS
+    // Every span is in flight at once, up to the size of the pool.
+    TestServer server([](const Seen& seen)
+    {
+        Reply reply;
+        reply.code = 206;
+        reply.body = seen.headers.at("range");
+        reply.delay = std::chrono::milliseconds(200);
+        return reply;
+    });
+
+    http::Pool pool(32, 0, "");
+    drivers::Http http(pool);
+
+    std::vector<ByteRange> ranges;
+    for (std::size_t i(0); i < 40; ++i) ranges.push_back({ i * 1000000, 1 });
+
+    const auto data(http.getRanges(server.host() + "/file", ranges, 0));
+    ASSERT_EQ(data.size(), ranges.size());
+    for (std::size_t i(0); i < ranges.size(); ++i)
+    {
+        const std::string range("bytes=" + std::to_string(i * 1000000) + "-" +
+            std::to_string(i * 1000000));
+        EXPECT_EQ(std::string(data[i].begin(), data[i].end()), range);
+    }
+    EXPECT_EQ(server.requests().size(), 40u);
+    EXPECT_EQ(server.peak(), 32u);
+#endif
+}
+
+TEST(Arbiter, ReadStreamSeek)
+{
+#ifndef ARBITER_WINDOWS
+    // Bytes 1 through 4 are slow to arrive.
+    const std::string file("0123456789");
+    TestServer server([&file](const Seen& seen)
+    {
+        Reply reply;
+        if (seen.method == "HEAD") reply.body = file;
+        else
+        {
+            const std::size_t pos(std::stoul(seen.headers.at("range").substr(6)));
+            reply.code = 206;
+            reply.body = file.substr(pos, 1);
+            if (pos >= 1 && pos <= 4) reply.delay = std::chrono::seconds(5);
+        }
+        return reply;
+    });
+
+    http::Pool pool(8, 0, "");
+    drivers::Http http(pool);
+
+    // Seeking past the bytes being read ahead, and closing the stream,
+    // give up on them rather than waiting for them.
+    const auto start(std::chrono::steady_clock::now());
+    {
+        auto stream(http.openRead(server.host() + "/file", 1, 4));
+        EXPECT_EQ(stream->get(), '0');
+        stream->seekg(8);
+        EXPECT_EQ(stream->get(), '8');
+        EXPECT_EQ(stream->get(), '9');
+    }
+    EXPECT_LT(
+            std::chrono::steady_clock::now() - start,
+            std::chrono::seconds(2));
+#endif
+}
+
+TEST(Arbiter, S3UploadAbort)
+{
+#ifndef ARBITER_WINDOWS
+    // Takes the parts of any upload, but fails to complete the one at
+    // "fail".
+    TestServer server([](const Seen& seen)
+    {
+        Reply reply;
+        if (seen.method == "POST" &&
+            seen.target.find("?uploads") != std::string::npos)
+        {
+            reply.body =
+                "<InitiateMultipartUploadResult><UploadId>id</UploadId>"
+                "</InitiateMultipartUploadResult>";
+        }
+        else if (seen.method == "PUT") reply.headers["ETag"] = "\"etag\"";
+        else if (seen.target.find("/fail?") != std::string::npos)
+        {
+            reply.body = "<Error><Code>InternalError</Code></Error>";
+        }
+        return reply;
+    });
+
+    Arbiter a(
+            R"({ "s3": { "endpoint": ")" + server.url() + R"(", )"
+            R"("access": "a", "secret": "b", "region": "us-east-1" } })");
+
+    const std::size_t partSize(5 * 1024 * 1024);
+    const std::string data(partSize + 1, 'x');
+    const std::string root("s3://my.bucket/");
+
+    {
+        auto stream(a.openWrite(root + "abandoned", partSize));
+        *stream << data;
+    }
+    {
+        auto stream(a.openWrite(root + "fail", partSize));
+        *stream << data;
+        EXPECT_THROW(stream->close(), ArbiterError);
+    }
+    {
+        auto stream(a.openWrite(root + "done", partSize));
+        *stream << data;
+        stream->close();
+    }
+
+    // Only the uploads which were started but not completed are aborted.
+    std::vector<std::string> aborted;
+    for (const auto& seen : server.requests())
+    {
+        if (seen.method == "DELETE") aborted.push_back(seen.target);
+    }
+    const std::vector<std::string> expected {
+        "/my.bucket/abandoned?uploadId=id",
+        "/my.bucket/fail?uploadId=id"
+    };
+    EXPECT_EQ(aborted, expected);
+#endif
+}
+
+TEST(Arbiter, BatchThreads)
+{
+#ifdef __linux__
+    // The threads of this process, or zero if unknown.
+    auto threads([]()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.rfind("Threads:", 0) == 0) return std::stoul(line.substr(8));
+        }
+        return 0ul;
+    });
+
+    TestServer server(slowly(200));
+    Arbiter a(R"({ "http": { "concurrent": 16 } })");
+    // Open all of the connections first, since the server has a thread for
+    // each.
+    a.getMany(std::vector<std::string>(16, server.url("/warm")));
+
+    // Concurrent batches of remote reads share the pool, and need no
+    // threads of their own to wait on it.
+    const std::size_t before(threads());
+    std::atomic<bool> done(false);
+    std::size_t most(before);
+    std::thread watcher([&]()
+    {
+        while (!done)
+        {
+            most = (std::max)(most, threads());
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+
+    std::vector<std::future<std::vector<BatchResult>>> batches;
+    for (int b(0); b < 4; ++b)
+    {
+        batches.push_back(std::async(std::launch::async, [&a, &server, b]()
+        {
+            std::vector<std::string> paths;
+            for (int i(0); i < 16; ++i)
+            {
+                paths.push_back(server.url("/" + std::to_string(b * 16 + i)));
+            }
+            return a.getMany(paths);
+        }));
+    }
+
+    for (int b(0); b < 4; ++b)
+    {
+        const auto results(batches[b].get());
+        ASSERT_EQ(results.size(), 16u);
+        for (int i(0); i < 16; ++i)
+        {
+            EXPECT_TRUE(results[i].ok()) << results[i].error;
+            const std::string data(results[i].data.begin(), results[i].data.end());
+            EXPECT_EQ(data, "/" + std::to_string(b * 16 + i));
+        }
+    }
+    done = true;
+    watcher.join();
+
+    EXPECT_EQ(server.peak(), 16u);
+    // The batches and the watcher have a thread each.
+    if (before) { EXPECT_LE(most - before, 8u); }
+#endif
+}
+
+TEST(Arbiter, PoolSize)
+{
+    Arbiter a(R"({ "http": { "concurrent": 5 } })");
+    EXPECT_EQ(a.httpPool().concurrent(), 5u);
+
+    // A pool with no handles could never run anything.
+    http::Pool empty(0, 0, "");
+    EXPECT_THROW(empty.acquire(), std::runtime_error);
+    EXPECT_THROW(empty.submit(http::Request()), std::runtime_error);
+
+#ifndef ARBITER_WINDOWS
+    // No more transfers than handles run at once.
+    TestServer server(slowly(100));
+    http::Pool pool(3, 0, R"({ "http": { "minConcurrent": 0, "idleTimeout": 0 } })");
+    auto responses(getAll(pool, numbered(server.url("/"), 9)));
+    for (std::size_t i(0); i < responses.size(); ++i)
+    {
+        EXPECT_EQ(responses[i].code(), 200);
+        EXPECT_EQ(body(responses[i]), "/" + std::to_string(i));
+    }
+    EXPECT_EQ(server.peak(), 3u);
+
+    // Handles closed for idling are reopened for the next requests.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    responses = getAll(pool, numbered(server.url("/again/"), 6));
+    for (std::size_t i(0); i < responses.size(); ++i)
+    {
+        EXPECT_EQ(responses[i].code(), 200);
+        EXPECT_EQ(body(responses[i]), "/again/" + std::to_string(i));
+    }
+    EXPECT_EQ(server.peak(), 3u);
+    EXPECT_EQ(server.requests().size(), 15u);
+#endif
+}
+
+TEST(Arbiter, PoolRunners)
+{
+#ifndef ARBITER_WINDOWS
+    std::string big(2 * 1024 * 1024, 0);
+    for (std::size_t i(0); i < big.size(); ++i) big[i] = static_cast<char>(i % 251);
+
+    // The epoll runner falls back to the poll runner off Linux.
+    for (const std::string runner : { "poll", "epoll" })
+    {
+        TestServer server([&big](const Seen& seen)
+        {
+            Reply reply(TestServer::echo(seen));
+            if (seen.target == "/big") reply.body = big;
+            else reply.delay = std::chrono::milliseconds(100);
+            return reply;
+        });
+
+        http::Pool pool(4, 0, R"({ "http": { "runner": ")" + runner + R"(" } })");
+
+        // Transfers run side by side, each with its own response.
+        auto responses(getAll(pool, numbered(server.url("/"), 8)));
+        for (std::size_t i(0); i < responses.size(); ++i)
+        {
+            EXPECT_EQ(responses[i].code(), 200) << runner;
+            EXPECT_EQ(body(responses[i]), "/" + std::to_string(i)) << runner;
+        }
+        EXPECT_EQ(server.peak(), 4u) << runner;
+
+        // Bodies arriving over many reads are whole.
+        http::Request req;
+        req.path = server.url("/big");
+        http::Response res(pool.submit(req).get());
+        EXPECT_EQ(res.code(), 200) << runner;
+        EXPECT_TRUE(body(res) == big) << runner;
+    }
+#endif
+
+    EXPECT_THROW(
+        http::Pool(2, 0, R"({ "http": { "runner": "select" } })"),
+        ArbiterError);
+}
+
+TEST(Arbiter, PoolShards)
+{
+#ifndef ARBITER_WINDOWS
+    // Completions come from the runner of the shard whose handle ran the
+    // transfer, and the handles of every shard run at once.
+    auto run([](http::Pool& pool, TestServer& server, std::size_t n)
+    {
+        std::mutex mutex;
+        std::set<std::thread::id> runners;
+        std::vector<std::future<http::Response>> futures;
+        for (auto& req : numbered(server.url("/"), n))
+        {
+            auto promise(std::make_shared<std::promise<http::Response>>());
+            futures.push_back(promise->get_future());
+            pool.submit(req, [&mutex, &runners, promise](http::Response res)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    runners.insert(std::this_thread::get_id());
+                }
+                promise->set_value(std::move(res));
+            });
+        }
+        for (auto& f : futures) EXPECT_EQ(f.get().code(), 200);
+        return runners.size();
+    });
+
+    for (const std::string runner : { "poll", "epoll" })
+    {
+        TestServer server(slowly(100));
+        http::Pool pool(
+            8,
+            0,
+            R"({ "http": { "shards": 3, "runner": ")" + runner + R"(" } })");
+        EXPECT_EQ(run(pool, server, 16), 3u) << runner;
+        EXPECT_EQ(server.peak(), 8u) << runner;
+    }
+
+    // Never more shards than handles.
+    TestServer server(slowly(10));
+    http::Pool small(1, 0, R"({ "http": { "shards": 4 } })");
+    EXPECT_EQ(run(small, server, 5), 1u);
+    EXPECT_EQ(server.peak(), 1u);
+#endif
+}
+
+TEST(Arbiter, TokenBucket)
+{
+    using ms = std::chrono::milliseconds;
+    const auto start(http::TokenBucket::Clock::now());
+
+    http::TokenBucket unlimited;
+    unlimited.take(1e9);
+    EXPECT_TRUE(unlimited.ready(start));
+
+    // Starts with a second's worth.
+    http::TokenBucket bucket(10);
+    bucket.updated = start;
+    for (int i(0); i < 10; ++i)
+    {
+        EXPECT_TRUE(bucket.ready(start));
+        bucket.take(1);
+    }
+    EXPECT_FALSE(bucket.ready(start));
+
+    // Refills with time, a whole token at a time, and may be overdrawn.
+    EXPECT_FALSE(bucket.ready(start + ms(50)));
+    EXPECT_TRUE(bucket.ready(start + ms(150)));
+    bucket.take(5);
+    EXPECT_FALSE(bucket.ready(start + ms(150)));
+    EXPECT_GE(bucket.readyAt(), start + ms(600));
+    EXPECT_LE(bucket.readyAt(), start + ms(610));
+
+    // Nothing more until the debt is paid back.
+    EXPECT_FALSE(bucket.ready(start + ms(550)));
+    EXPECT_TRUE(bucket.ready(bucket.readyAt()));
+
+    // Never holds more than a second's worth.
+    EXPECT_TRUE(bucket.ready(start + std::chrono::seconds(100)));
+    EXPECT_DOUBLE_EQ(bucket.tokens, 10);
+
+#ifndef ARBITER_WINDOWS
+    // The times at which each request reached @p server after the first.
+    const auto arrivals([](const TestServer& server)
+    {
+        std::vector<ms> times;
+        const auto requests(server.requests());
+        for (const auto& seen : requests)
+        {
+            times.push_back(std::chrono::duration_cast<ms>(
+                seen.at - requests.front().at));
+        }
+        std::sort(times.begin(), times.end());
+        return times;
+    });
+
+    // A second's worth of requests may arrive at once, and the rest no
+    // sooner than the rate allows, give or take a little for the clock.
+    const auto paced([](const std::vector<ms>& times, int rate)
+    {
+        for (std::size_t i(rate); i < times.size(); ++i)
+        {
+            const ms due((i + 1 - rate) * 1000 / rate);
+            EXPECT_GE(times[i], due - ms(10)) << "Request " << i;
+        }
+    });
+
+    {
+        TestServer server;
+        http::Pool pool(4, 0, R"({ "http": { "requestsPerSecond": 20 } })");
+        for (auto& res : getAll(pool, numbered(server.url("/"), 30)))
+        {
+            EXPECT_EQ(res.code(), 200);
+        }
+
+        const auto times(arrivals(server));
+        ASSERT_EQ(times.size(), 30u);
+        paced(times, 20);
+        EXPECT_LT(times.back(), ms(1000));
+    }
+
+    // A host limit holds back that host alone.
+    {
+        TestServer limited;
+        TestServer free;
+        http::Pool pool(
+            4, 0,
+            R"({ "http": { "hosts": { ")" + limited.host() +
+            R"(": { "requestsPerSecond": 10 } } } })");
+
+        auto reqs(numbered(limited.url("/"), 15));
+        for (auto& req : numbered(free.url("/"), 15)) reqs.push_back(req);
+        for (auto& res : getAll(pool, reqs)) EXPECT_EQ(res.code(), 200);
+
+        const auto times(arrivals(limited));
+        ASSERT_EQ(times.size(), 15u);
+        paced(times, 10);
+        EXPECT_LT(arrivals(free).back(), ms(300));
+    }
+#endif
+}
+
+TEST(Arbiter, Coalescing)
+{
+    http::Request a;
+    a.path = "http://example.com/file";
+    a.query["x"] = "1";
+    a.headers["Range"] = "bytes=0-9";
+
+    http::Request b(a);
+    EXPECT_EQ(http::flightKey(a), http::flightKey(b));
+
+    b.verb = http::Request::Verb::HEAD;
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    b = a;
+    b.query["x"] = "2";
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    b = a;
+    b.headers["Range"] = "bytes=10-19";
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    b = a;
+    b.path = "http://example.com/other";
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    // Signing the same request again a moment later changes nothing.
+    a.headers["Authorization"] = "AWS4-HMAC-SHA256 Signature=1";
+    a.headers["X-Amz-Date"] = "20260101T000000Z";
+    b = a;
+    b.headers["Authorization"] = "AWS4-HMAC-SHA256 Signature=2";
+    b.headers["X-Amz-Date"] = "20260101T000001Z";
+    EXPECT_EQ(http::flightKey(a), http::flightKey(b));
+
+    b = a;
+    b.headers["If-None-Match"] = "\"abc\"";
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    // Nor does one request share the priority, retries or timeout of another.
+    b = a;
+    b.priority = http::Priority::High;
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    b = a;
+    b.retry = 0;
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+    b = a;
+    b.timeout = 30;
+    EXPECT_NE(http::flightKey(a), http::flightKey(b));
+
+#ifndef ARBITER_WINDOWS
+    // Requests which are only signed differently share one transfer while
+    // it is outstanding, and each gets its own copy of the response.  Those
+    // for another range or with another timeout get transfers of their own.
+    TestServer server(slowly(200));
+    http::Pool pool(4, 0, R"({ "http": { "coalesce": true } })");
+
+    std::vector<http::Request> reqs;
+    for (int i(0); i < 20; ++i)
+    {
+        http::Request req;
+        req.path = server.url("/file");
+        req.retry = 0;
+        req.headers["Authorization"] = "Signature=" + std::to_string(i);
+        req.headers["X-Amz-Date"] = "20260101T0000" + std::to_string(10 + i);
+        if (i % 4 == 1) req.headers["Range"] = "bytes=0-9";
+        if (i % 4 == 2) req.timeout = 30;
+        reqs.push_back(req);
+    }
+
+    for (auto& res : getAll(pool, reqs))
+    {
+        EXPECT_EQ(res.code(), 200);
+        EXPECT_EQ(body(res), "/file");
+    }
+
+    const auto requests(server.requests());
+    EXPECT_EQ(requests.size(), 3u);
+    std::size_t ranged(0);
+    for (const auto& seen : requests) ranged += seen.headers.count("range");
+    EXPECT_EQ(ranged, 1u);
+
+    // Once it has landed, the next request makes a transfer of its own.
+    for (auto& res : getAll(pool, { reqs.front() }))
+    {
+        EXPECT_EQ(res.code(), 200);
+    }
+    EXPECT_EQ(server.requests().size(), 4u);
+#endif
+}
+
+TEST(Arbiter, Cancellation)
+{
+    using ms = std::chrono::milliseconds;
+
+    const http::Cancellation never;
+    EXPECT_FALSE(never);
+    EXPECT_FALSE(never.cancelled());
+    never.cancel();
+    EXPECT_FALSE(never.cancelled());
+
+    const auto passed(http::Cancellation::at(
+            http::Cancellation::Clock::now() - ms(1)));
+    EXPECT_TRUE(passed.cancelled());
+
+    const auto later(http::Cancellation::after(ms(50)));
+    EXPECT_FALSE(later.cancelled());
+    std::this_thread::sleep_for(ms(60));
+    EXPECT_TRUE(later.cancelled());
+
+    // Listeners hear a cancel once, and copies share it.
+    const auto c(http::Cancellation::create());
+    const http::Cancellation copy(c);
+    int heard(0);
+    int gone(0);
+    c.listen([&heard]() { ++heard; });
+    c.unlisten(c.listen([&gone]() { ++gone; }));
+    copy.cancel();
+    copy.cancel();
+    EXPECT_TRUE(c.cancelled());
+    EXPECT_EQ(heard, 1);
+    EXPECT_EQ(gone, 0);
+
+    // Requests given up on complete with a code of zero.
+    http::Pool pool(2, 0, "");
+    http::Request req;
+    req.path = refused;
+    req.cancel = c;
+    EXPECT_EQ(pool.submit(req).get().code(), 0);
+
+    {
+        const http::CancellationScope scope(c);
+        EXPECT_TRUE(http::CancellationScope::current().cancelled());
+        EXPECT_EQ(pool.acquire().get(refused).code(), 0);
+    }
+    EXPECT_FALSE(http::CancellationScope::current());
+
+    // Retries which could not start before the deadline are not made.
+    req.cancel = http::Cancellation::after(ms(200));
+    req.retry = 10;
+    const auto start(std::chrono::steady_clock::now());
+    EXPECT_EQ(pool.submit(req).get().code(), 0);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+
+#ifndef ARBITER_WINDOWS
+    // A cancel which lands while the request is being submitted still stops
+    // it, rather than leaving it to wait out a slow server.
+    TestServer server(slowly(10000));
+    for (int i(0); i < 200; ++i)
+    {
+        const auto c(http::Cancellation::create());
+        req = http::Request();
+        req.path = server.url("/");
+        req.retry = 0;
+        req.cancel = c;
+
+        std::thread canceller([c]() { c.cancel(); });
+        auto future(pool.submit(req));
+        canceller.join();
+
+        ASSERT_EQ(
+            future.wait_for(std::chrono::seconds(2)),
+            std::future_status::ready) << "Request " << i;
+        EXPECT_EQ(future.get().code(), 0);
+    }
+#endif
+}
+
+TEST(Arbiter, PoolHandleReuse)
+{
+#ifndef ARBITER_WINDOWS
+    // One handle, configured once, runs every kind of request in turn, and
+    // nothing set for one request leaks into the next.
+    TestServer server;
+    http::Pool pool(1, 0, "");
+    http::Resource resource(pool.acquire());
+    const std::vector<char> data { 'a', 'b', 'c' };
+    const std::vector<char> form { 'x', '=', '1' };
+
+    for (int i(0); i < 2; ++i)
+    {
+        http::Response res(resource.head(server.url("/head")));
+        EXPECT_EQ(res.code(), 200);
+        EXPECT_EQ(body(res), "");
+
+        res = resource.get(server.url("/range"), { { "Range", "bytes=0-1" } });
+        EXPECT_EQ(body(res), "/range");
+
+        res = resource.put(server.url("/put"), data, {}, { { "x", "1" } }, 0);
+        EXPECT_EQ(res.code(), 200);
+
+        res = resource.get(server.url("/get"));
+        EXPECT_EQ(body(res), "/get");
+
+        res = resource.post(server.url("/post"), form);
+        EXPECT_EQ(res.code(), 200);
+
+        std::string got;
+        const http::Sink sink([&got](const char* data, std::size_t n)
+        {
+            got.append(data, n);
+            return true;
+        });
+        res = resource.get(server.url("/sink"), sink, {}, {}, 0);
+        EXPECT_EQ(res.code(), 200);
+        EXPECT_EQ(got, "/sink");
+    }
+
+    const auto seen(server.requests());
+    ASSERT_EQ(seen.size(), 12u);
+    for (std::size_t i(0); i < seen.size(); i += 6)
+    {
+        EXPECT_EQ(seen[i].method, "HEAD");
+
+        EXPECT_EQ(seen[i + 1].method, "GET");
+        EXPECT_EQ(seen[i + 1].headers.at("range"), "bytes=0-1");
+        EXPECT_EQ(seen[i + 1].body, "");
+
+        EXPECT_EQ(seen[i + 2].method, "PUT");
+        EXPECT_EQ(seen[i + 2].target, "/put?x=1");
+        EXPECT_EQ(seen[i + 2].headers.at("content-length"), "3");
+        EXPECT_EQ(seen[i + 2].body, "abc");
+        EXPECT_FALSE(seen[i + 2].headers.count("range"));
+
+        EXPECT_EQ(seen[i + 3].method, "GET");
+        EXPECT_EQ(seen[i + 3].target, "/get");
+        EXPECT_FALSE(seen[i + 3].headers.count("range"));
+        EXPECT_FALSE(seen[i + 3].headers.count("content-length"));
+
+        EXPECT_EQ(seen[i + 4].method, "POST");
+        EXPECT_EQ(seen[i + 4].body, "x=1");
+
+        EXPECT_EQ(seen[i + 5].method, "GET");
+        EXPECT_FALSE(seen[i + 5].headers.count("content-length"));
+        EXPECT_FALSE(seen[i + 5].headers.count("content-type"));
+        EXPECT_EQ(seen[i + 5].body, "");
+    }
+
+    // All over the one connection of the one handle.
+    EXPECT_EQ(server.connections(), 1u);
+#endif
+}
+
+#ifndef ARBITER_WINDOWS
+TEST(Arbiter, PoolHttp2)
+{
+    // HTTP/2 is only negotiated over TLS, so plain-text requests stay on
+    // HTTP/1.1 unless the server is known to speak HTTP/2.
+    {
+        TestServer server;
+        http::Pool pool(4, 0, R"({ "http": { "http2": true } })");
+
+        auto responses(getAll(pool, numbered(server.url("/"), 4)));
+        for (std::size_t i(0); i < responses.size(); ++i)
+        {
+            EXPECT_EQ(responses[i].code(), 200);
+            EXPECT_EQ(body(responses[i]), "/" + std::to_string(i));
+        }
+        for (const auto& seen : server.requests())
+        {
+            EXPECT_EQ(seen.version, "HTTP/1.1");
+            EXPECT_FALSE(seen.headers.count("upgrade"));
+        }
+    }
+
+    // With h2c, the requests of every handle are multiplexed as streams of
+    // one connection, a few of them in flight at once.  Older versions of
+    // libcurl stay on HTTP/1.1 instead.
+    {
+        const bool h2c(
+            curl_version_info(CURLVERSION_NOW)->version_num >= 0x080000);
+
+        TestServer server(slowly(200));
+        http::Pool pool(4, 0, R"({ "http": { "h2c": true, "shards": 1 } })");
+
+        for (auto& res : getAll(pool, numbered(server.url("/"), 12)))
+        {
+            EXPECT_EQ(res.code(), 200);
+        }
+
+        const auto requests(server.requests());
+        EXPECT_EQ(requests.size(), 12u);
+        for (const auto& seen : requests)
+        {
+            EXPECT_EQ(seen.version, h2c ? "HTTP/2" : "HTTP/1.1");
+        }
+        EXPECT_EQ(server.peak(), 4u);
+        if (h2c)
+        {
+            EXPECT_EQ(server.connections(), 1u);
+        }
+    }
+}
+#endif
+
+TEST(Arbiter, ConcurrencyWindow)
+{
+    using us = std::chrono::microseconds;
+    using Clock = http::ConcurrencyWindow::Clock;
+
+    http::ConcurrencyWindow w;
+    w.size = w.max = 16;
+
+    // Throttling halves the window, once per round of transfers.
+    const auto before(Clock::now());
+    w.update(503, us(0), before, 0);
+    EXPECT_EQ(w.size, 8);
+    w.update(429, us(0), before, 0);
+    EXPECT_EQ(w.size, 8);
+    w.update(429, us(0), Clock::now(), 0);
+    EXPECT_EQ(w.size, 4);
+
+    // Success grows it by one per window's worth, up to its largest.
+    for (int i(0); i < 4; ++i) w.update(200, us(1000), Clock::now(), 0);
+    EXPECT_NEAR(w.size, 5, 0.1);
+    for (int i(0); i < 1000; ++i) w.update(200, us(1000), Clock::now(), 0);
+    EXPECT_EQ(w.size, 16);
+
+    // Latency well over the best seen counts as congestion if asked.
+    w.update(200, us(5000), Clock::now(), 0);
+    EXPECT_EQ(w.size, 16);
+    w.update(200, us(5000), Clock::now(), 3);
+    EXPECT_EQ(w.size, 8);
+
+    // Never below one.
+    for (int i(0); i < 10; ++i) w.update(503, us(0), Clock::now(), 0);
+    EXPECT_EQ(w.size, 1);
+
+#ifndef ARBITER_WINDOWS
+    const auto handler([](const Seen& seen)
+    {
+        Reply reply(TestServer::echo(seen));
+        if (seen.target.find("/busy") == 0) reply.code = 503;
+        reply.delay = std::chrono::milliseconds(100);
+        return reply;
+    });
+    http::Pool pool(
+        8, 0, R"({ "http": { "adaptive": true, "adaptiveLatency": 0 } })");
+
+    // A 503 in each of three rounds takes the window of a host down to one
+    // transfer.  From there it grows by one for each window's worth of
+    // successes: one at a time, then two, then three.
+    TestServer congested(handler);
+    for (int i(0); i < 3; ++i)
+    {
+        for (auto& res : getAll(pool, numbered(congested.url("/busy/"), 1)))
+        {
+            EXPECT_EQ(res.code(), 503);
+        }
+    }
+    for (auto& res : getAll(pool, numbered(congested.url("/slow/"), 8)))
+    {
+        EXPECT_EQ(res.code(), 200);
+    }
+    EXPECT_EQ(congested.requests().size(), 11u);
+    EXPECT_GE(congested.peak(), 2u);
+    EXPECT_LE(congested.peak(), 3u);
+
+    // Another host has a window of its own, the size of the pool.
+    TestServer other(handler);
+    for (auto& res : getAll(pool, numbered(other.url("/slow/"), 8)))
+    {
+        EXPECT_EQ(res.code(), 200);
+    }
+    EXPECT_EQ(other.peak(), 8u);
+#endif
+}
+
+TEST(Arbiter, PoolSharedCaches)
+{
+#ifndef ARBITER_WINDOWS
+    TestServer server;
+
+    // A name which can't be looked up, pinned to the server by one pool.
+    // Handles elsewhere only find it in the DNS cache that they all share.
+    const std::string port(std::to_string(server.port()));
+    const std::string name("shared-" + port + ".invalid");
+    const std::string url("http://" + name + ":" + port + "/");
+
+    http::Pool pinned(
+        1,
+        0,
+        R"({ "http": { "resolve": [")" + name + ":" + port + R"(:127.0.0.1"] } })");
+    http::Request req;
+    req.path = url;
+    req.retry = 0;
+    EXPECT_EQ(pinned.submit(req).get().code(), 200);
+
+    // Handles of many pools and shards, on many threads, use it at once.
+    std::vector<std::future<bool>> runs;
+    for (int i(0); i < 4; ++i)
+    {
+        runs.push_back(std::async(std::launch::async, [&url]()
+        {
+            bool ok(true);
+            for (int j(0); j < 3; ++j)
+            {
+                http::Pool pool(4, 0, R"({ "http": { "shards": 2 } })");
+                for (auto& res : getAll(pool, numbered(url, 4)))
+                {
+                    ok = ok && res.code() == 200;
+                }
+            }
+            return ok;
+        }));
+    }
+    for (auto& r : runs) EXPECT_TRUE(r.get());
+    EXPECT_EQ(server.requests().size(), 49u);
+#endif
+}
+
+TEST(Arbiter, PoolOrder)
+{
+    // With a single handle, waiting transfers get it in arrival order.
+    http::Pool pool(1, 0, "");
+
+    http::Request req;
+    req.path = refused;
+    req.retry = 0;
+
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<std::future<http::Response>> futures;
+    for (int i(0); i < 10; ++i)
+    {
+        pool.submit(req, [&mutex, &order, i](http::Response)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+        });
+    }
+
+    // Completes after all of those above.
+    EXPECT_EQ(pool.submit(req).get().code(), 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<int> expected(10);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(order, expected);
+}
+
+class DriverTest : public ::testing::TestWithParam<std::string> { };
+
+TEST_P(DriverTest, PutGet)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "test.txt");
+    const std::string data("Testing path " + path);
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, data));
+    EXPECT_EQ(a.get(path), data);
+}
+
+TEST_P(DriverTest, HttpRange)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "range.txt");
+    const std::string data("0123456789");
+
+    const std::size_t x(2);
+    const std::size_t y(8);
+    const http::Headers headers{
+        // The range header is inclusive of the end, so subtract 1 here.
+        { "Range", "bytes=" + std::to_string(x) + "-" + std::to_string(y - 1) }
+    };
+
+    if (!a.isHttpDerived(root)) return;
+
+    EXPECT_NO_THROW(a.put(path, data));
+    EXPECT_EQ(a.get(path, headers), data.substr(x, y - x));
+}
+
+TEST_P(DriverTest, Range)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "getrange.txt");
+    const std::string data("0123456789");
+
+    auto str([](const std::vector<char>& v) { return std::string(v.begin(), v.end()); });
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, data));
+    EXPECT_EQ(str(a.getRange(path, 2, 6)), data.substr(2, 6));
+
+    // Ranges are cut short at the end of the file, and can't start past it.
+    EXPECT_EQ(str(a.getRange(path, 8, 10)), data.substr(8));
+    EXPECT_FALSE(a.tryGetRange(path, 10, 1));
+    EXPECT_THROW(a.getRange(path, 10, 1), ArbiterError);
+}
+
+TEST_P(DriverTest, Ranges)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "getranges.txt");
+    const std::string data("0123456789");
+
+    auto str([](const std::vector<char>& v) { return std::string(v.begin(), v.end()); });
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, data));
+
+    // Out of order, overlapping, empty, and cut short by the end of the file.
+    const std::vector<ByteRange> ranges {
+        { 7, 5 }, { 0, 2 }, { 4, 0 }, { 1, 4 }, { 3, 2 }
+    };
+
+    for (const std::size_t gap : { 0, 1, 64 })
+    {
+        const auto results(a.getRanges(path, ranges, gap));
+        ASSERT_EQ(results.size(), ranges.size());
+        EXPECT_EQ(str(results[0]), "789");
+        EXPECT_EQ(str(results[1]), "01");
+        EXPECT_EQ(str(results[2]), "");
+        EXPECT_EQ(str(results[3]), "1234");
+        EXPECT_EQ(str(results[4]), "34");
+    }
+
+    EXPECT_THROW(a.getRanges(path, { { 0, 2 }, { 10, 1 } }), ArbiterError);
+}
+
+TEST_P(DriverTest, ReadStream)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "readstream.txt");
+    const std::string data("0123456789");
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, data));
+
+    auto stream(a.openRead(path, 3, 2));
+    EXPECT_EQ(stream->size(), data.size());
+
+    std::string all(std::istreambuf_iterator<char>(*stream), { });
+    EXPECT_EQ(all, data);
+
+    // Seek within the current chunk, behind it, and ahead of it.
+    std::string part(4, 0);
+    stream->clear();
+    stream->seekg(8);
+    EXPECT_TRUE(stream->read(&part[0], 2));
+    EXPECT_EQ(part.substr(0, 2), "89");
+    stream->seekg(-9, std::ios::end);
+    EXPECT_TRUE(stream->read(&part[0], 4));
+    EXPECT_EQ(part, "1234");
+    EXPECT_EQ(stream->tellg(), 5);
+    stream->seekg(2, std::ios::cur);
+    EXPECT_TRUE(stream->read(&part[0], 2));
+    EXPECT_EQ(part.substr(0, 2), "78");
+
+    EXPECT_FALSE(stream->read(&part[0], 4));
+    EXPECT_EQ(stream->gcount(), 1);
+
+    EXPECT_THROW(a.openRead(root + "missing.txt"), ArbiterError);
+}
+
+TEST_P(DriverTest, WriteStream)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    const std::string path(root + "writestream.txt");
+
+    if (a.isLocal(root)) mkdirp(root);
+
+    EXPECT_NO_THROW(a.put(path, "old"));
+
+    // The file is left as it was until the stream is closed.
+    {
+        auto stream(a.openWrite(path, 4));
+        *stream << "abandoned";
+    }
+    EXPECT_EQ(a.get(path), "old");
+
+    auto stream(a.openWrite(path, 4));
+    *stream << "0123456789";
+    EXPECT_TRUE(stream->good());
+    EXPECT_EQ(a.get(path), "old");
+    *stream << "abc";
+    stream->close();
+    EXPECT_EQ(a.get(path), "0123456789abc");
+
+    // Whole parts only.
+    stream = a.openWrite(path, 4);
+    *stream << "01234567";
+    stream->close();
+    EXPECT_EQ(a.get(path), "01234567");
+
+    stream = a.openWrite(path, 4);
+    stream->close();
+    EXPECT_EQ(a.get(path), "");
+}
+
+TEST_P(DriverTest, Batch)
+{
+    Arbiter a;
+
+    const std::string root(GetParam());
+    if (a.isLocal(root)) mkdirp(root);
+
+    std::vector<std::pair<std::string, std::vector<char>>> items;
+    std::vector<std::string> paths;
+    for (int i(0); i < 8; ++i)
+    {
+        const std::string name("batch-" + std::to_string(i) + ".txt");
+        const std::string data(std::to_string(i * 100));
+        items.emplace_back(root + name, std::vector<char>(data.begin(), data.end()));
+        paths.push_back(root + name);
+    }
+
+    const auto puts(a.putMany(items, 3));
+    ASSERT_EQ(puts.size(), items.size());
+    for (const auto& r : puts) EXPECT_TRUE(r.ok()) << r.error;
+
+    // Failures are reported per item, in place.
+    paths.insert(paths.begin() + 2, root + "batch-missing.txt");
+
+    const auto gets(a.getMany(paths));
+    ASSERT_EQ(gets.size(), paths.size());
+    EXPECT_FALSE(gets[2].ok());
+    EXPECT_TRUE(gets[2].data.empty());
+
+    for (std::size_t i(0); i < items.size(); ++i)
+    {
+        const auto& r(gets[i < 2 ? i : i + 1]);
+        EXPECT_TRUE(r.ok()) << r.error;
+        EXPECT_EQ(r.data, items[i].second);
+    }
+
+    const Endpoint ep(a.getEndpoint(root));
+    const auto sub(ep.getMany({ "batch-0.txt", "batch-7.txt" }, 1));
+    ASSERT_EQ(sub.size(), 2u);
+    EXPECT_EQ(sub[0].data, items[0].second);
+    EXPECT_EQ(sub[1].data, items[7].second);
 }
 
 TEST_P(DriverTest, Glob)